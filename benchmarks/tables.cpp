@@ -0,0 +1,467 @@
+#include <cmath>
+#include <map>
+#include <memory>
+#include <thread>
+
+#include <pbd/common/BBox.hpp>
+#include <pbd/hashing/DVTable.hpp>
+#include <pbd/hashing/DenseTable.hpp>
+#include <pbd/hashing/HTable.hpp>
+#include <pbd/hashing/SortTable.hpp>
+#include <pbd/hashing/PartitionTable.hpp>
+#include <pbd/hashing/OverlapList.hpp>
+#include <pbd/hashing/Islands.hpp>
+#include <pbd/hashing/Executor.hpp>
+
+#include <Scenes.hpp>
+
+#include <benchmark/benchmark.h>
+
+using namespace pbd;
+
+using scalar_t = float;
+using index_t = int32_t;
+using bbox_t = BBox<3, scalar_t>;
+using vec_t = bbox_t::vec_t;
+
+namespace {
+	// Average distance between objects, the domain grows with the object count so the density stays the same.
+	constexpr scalar_t Spacing = 1.f;
+	constexpr scalar_t CellSize = 1.f;
+
+	using Scene = scenes::Scene<3, scalar_t, index_t>;
+
+	enum Distribution : int64_t {
+		Uniform,
+		Fluid,
+		Clusters,
+		HeavyTailed,
+		Thin,
+	};
+
+	bbox_t domainFor(size_t count) {
+		scalar_t side = std::cbrt(static_cast<scalar_t>(count)) * Spacing;
+		return bbox_t(vec_t(-side * 0.5f), vec_t(side * 0.5f));
+	}
+
+	Scene makeScene(Distribution dist, size_t count) {
+		bbox_t domain = domainFor(count);
+		switch (dist) {
+		default:
+		case Uniform:
+			return scenes::uniformPoints<3, scalar_t, index_t>(count, domain, 0.4f, count);
+		case Fluid: {
+			int32_t side = static_cast<int32_t>(std::ceil(std::cbrt(static_cast<double>(count))));
+			return scenes::fluidBlock<3, scalar_t, index_t>(domain.min, glm::ivec3(side), Spacing, 0.6f, 0.1f, count);
+		}
+		case Clusters:
+			return scenes::gaussianClusters<3, scalar_t, index_t>(count, std::max<size_t>(1, count / 1000), domain, 4.f, 0.4f, count);
+		case HeavyTailed:
+			return scenes::heavyTailed<3, scalar_t, index_t>(count, domain, 0.1f, 64.f, 1.5f, count);
+		case Thin:
+			return scenes::thinBoxes<3, scalar_t, index_t>(count, domain, 8.f, 0.1f, count);
+		}
+	}
+
+	// Scenes are cached, generating ten million boxes takes longer than most of the benchmarks.
+	const Scene& getScene(size_t count, Distribution dist = Uniform) {
+		static std::map<std::pair<Distribution, size_t>, std::unique_ptr<Scene>> cache;
+		auto& scene = cache[{ dist, count }];
+		if (!scene) {
+			scene.reset(new Scene(makeScene(dist, count)));
+		}
+		return *scene;
+	}
+
+	void objectCounts(benchmark::internal::Benchmark* bench) {
+		bench->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMillisecond);
+	}
+	void objectAndThreadCounts(benchmark::internal::Benchmark* bench) {
+		int hardware = std::max(1u, std::thread::hardware_concurrency());
+		for (int64_t count = 1000; count <= 10000000; count *= 10) {
+			for (int threads = 1; threads <= hardware; threads *= 2) {
+				bench->Args({ count, threads });
+			}
+		}
+		bench->Unit(benchmark::kMillisecond);
+	}
+
+	void objectCountsAndDistributions(benchmark::internal::Benchmark* bench) {
+		for (int64_t dist = Uniform; dist <= Thin; ++dist) {
+			for (int64_t count = 1000; count <= 1000000; count *= 10) {
+				bench->Args({ count, dist });
+			}
+		}
+		bench->Unit(benchmark::kMillisecond);
+	}
+
+	void setItems(benchmark::State& state, size_t count) {
+		state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+	}
+}
+
+static void DVTable_BuildPoints(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	DVTable<scalar_t, index_t, 3> table;
+	table.initialize(vec_t(CellSize));
+
+	for (auto _ : state) {
+		table.build(scene.ids.data(), scene.points.data(), scene.points.size());
+		benchmark::ClobberMemory();
+	}
+	setItems(state, scene.points.size());
+}
+BENCHMARK(DVTable_BuildPoints)->Apply(objectCounts);
+
+static void DVTable_BuildBoxes(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	DVTable<scalar_t, index_t, 3> table;
+	table.initialize(vec_t(CellSize));
+
+	for (auto _ : state) {
+		table.build(scene.bounds.data(), scene.bounds.size());
+		benchmark::ClobberMemory();
+	}
+	setItems(state, scene.bounds.size());
+}
+BENCHMARK(DVTable_BuildBoxes)->Apply(objectCounts);
+
+static void DVTable_Find(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	DVTable<scalar_t, index_t, 3> table;
+	table.initialize(vec_t(CellSize));
+	table.build(scene.ids.data(), scene.points.data(), scene.points.size());
+
+	for (auto _ : state) {
+		size_t found = 0;
+		for (const vec_t& point : scene.points) {
+			found += table.find(point).size();
+		}
+		benchmark::DoNotOptimize(found);
+	}
+	setItems(state, scene.points.size());
+}
+BENCHMARK(DVTable_Find)->Apply(objectCounts);
+
+static void DVTable_FindOverlaps(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	DVTable<scalar_t, index_t, 3> table;
+	table.initialize(vec_t(CellSize));
+	table.build(scene.bounds.data(), scene.bounds.size());
+
+	PairList<index_t> pairs;
+	for (auto _ : state) {
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.bounds.size(), pairs);
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	setItems(state, scene.bounds.size());
+	state.counters["pairs"] = static_cast<double>(pairs.size());
+}
+BENCHMARK(DVTable_FindOverlaps)->Apply(objectCounts);
+
+static void DenseTable_Build(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	DenseTable<scalar_t, index_t, 3> table;
+	table.initialize(vec_t(CellSize), domainFor(scene.size()));
+
+	for (auto _ : state) {
+		table.build(scene.bounds.data(), scene.size());
+		benchmark::ClobberMemory();
+	}
+	setItems(state, scene.size());
+}
+BENCHMARK(DenseTable_Build)->Apply(objectCounts);
+
+static void DenseTable_FindOverlaps(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	DenseTable<scalar_t, index_t, 3> table;
+	table.initialize(vec_t(CellSize), domainFor(scene.size()));
+	table.build(scene.bounds.data(), scene.size());
+
+	PairList<index_t> pairs;
+	for (auto _ : state) {
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	setItems(state, scene.size());
+}
+BENCHMARK(DenseTable_FindOverlaps)->Apply(objectCounts);
+
+static void HTable_Build(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	HTable<scalar_t, index_t, 3> table(vec_t(CellSize), 4);
+
+	for (auto _ : state) {
+		table.build(scene.bounds.data(), scene.bounds.size());
+		benchmark::ClobberMemory();
+	}
+	setItems(state, scene.bounds.size());
+}
+BENCHMARK(HTable_Build)->Apply(objectCounts);
+
+static void HTable_FindOverlaps(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	HTable<scalar_t, index_t, 3> table(vec_t(CellSize), 4);
+	table.build(scene.bounds.data(), scene.bounds.size());
+
+	OverlapList list;
+	for (auto _ : state) {
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.bounds.size(), list);
+		benchmark::ClobberMemory();
+	}
+	setItems(state, scene.bounds.size());
+	state.counters["pairs"] = static_cast<double>(list.numPairs());
+}
+BENCHMARK(HTable_FindOverlaps)->Apply(objectCounts);
+
+static void HTable_FindOverlapsPairs(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	HTable<scalar_t, index_t, 3> table(vec_t(CellSize), 4);
+	table.build(scene.bounds.data(), scene.bounds.size());
+
+	PairList<index_t> pairs;
+	for (auto _ : state) {
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.bounds.size(), pairs);
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	setItems(state, scene.bounds.size());
+}
+BENCHMARK(HTable_FindOverlapsPairs)->Apply(objectCounts);
+
+// Visiting the pairs directly, without writing them to a list first.
+static void HTable_ForEachOverlap(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	HTable<scalar_t, index_t, 3> table(vec_t(CellSize), 4);
+	table.build(scene.bounds.data(), scene.bounds.size());
+
+	for (auto _ : state) {
+		int64_t sum = 0;
+		table.forEachOverlap(scene.ids.data(), scene.bounds.data(), scene.bounds.size(), [&](index_t a, index_t b) {
+			sum += a ^ b;
+		});
+		benchmark::DoNotOptimize(sum);
+	}
+	setItems(state, scene.bounds.size());
+}
+BENCHMARK(HTable_ForEachOverlap)->Apply(objectCounts);
+
+// Particles, built and queried from the centers and radii without a bounds array.
+static std::vector<scalar_t> sceneRadii(const Scene& scene) {
+	std::vector<scalar_t> radii(scene.size());
+	for (size_t i = 0; i < radii.size(); ++i) {
+		radii[i] = (scene.bounds[i].max.x - scene.bounds[i].min.x) * scalar_t(0.5);
+	}
+	return radii;
+}
+static void HTable_BuildSpheres(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	std::vector<scalar_t> radii = sceneRadii(scene);
+	HTable<scalar_t, index_t, 3> table(vec_t(CellSize), 4);
+
+	for (auto _ : state) {
+		table.build(scene.points.data(), radii.data(), scene.size());
+		benchmark::ClobberMemory();
+	}
+	setItems(state, scene.size());
+}
+BENCHMARK(HTable_BuildSpheres)->Apply(objectCounts);
+
+static void HTable_FindOverlapsSpheres(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	std::vector<scalar_t> radii = sceneRadii(scene);
+	HTable<scalar_t, index_t, 3> table(vec_t(CellSize), 4);
+	table.build(scene.points.data(), radii.data(), scene.size());
+
+	SphereOverlap<3, scalar_t> spheres{ scene.points.data(), radii.data() };
+	PairList<index_t> pairs;
+	for (auto _ : state) {
+		table.findOverlaps(scene.ids.data(), spheres, scene.size(), pairs);
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	setItems(state, scene.size());
+	state.counters["pairs"] = static_cast<double>(pairs.size());
+}
+BENCHMARK(HTable_FindOverlapsSpheres)->Apply(objectCounts);
+
+// Queries split over a pool of the given size. A pool of one thread falls back to the serial query,
+// so the overhead of splitting shows up against the larger pools.
+static void HTable_FindOverlapsParallel(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	HTable<scalar_t, index_t, 3> table(vec_t(CellSize), 4);
+	table.build(scene.bounds.data(), scene.bounds.size());
+
+	ThreadPool pool(state.range(1));
+	PairList<index_t> pairs;
+	for (auto _ : state) {
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.bounds.size(), pairs, pool);
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	setItems(state, scene.bounds.size());
+}
+BENCHMARK(HTable_FindOverlapsParallel)->Apply(objectAndThreadCounts)->UseRealTime();
+
+static void DVTable_FindOverlapsParallel(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	DVTable<scalar_t, index_t, 3> table;
+	table.initialize(vec_t(CellSize));
+	table.build(scene.bounds.data(), scene.bounds.size());
+
+	ThreadPool pool(state.range(1));
+	PairList<index_t> pairs;
+	for (auto _ : state) {
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.bounds.size(), pairs, pool);
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	setItems(state, scene.bounds.size());
+}
+BENCHMARK(DVTable_FindOverlapsParallel)->Apply(objectAndThreadCounts)->UseRealTime();
+
+static void DenseTable_FindOverlapsParallel(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	DenseTable<scalar_t, index_t, 3> table;
+	table.initialize(vec_t(CellSize), domainFor(scene.size()));
+	table.build(scene.bounds.data(), scene.bounds.size());
+
+	ThreadPool pool(state.range(1));
+	PairList<index_t> pairs;
+	for (auto _ : state) {
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.bounds.size(), pairs, pool);
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	setItems(state, scene.bounds.size());
+}
+BENCHMARK(DenseTable_FindOverlapsParallel)->Apply(objectAndThreadCounts)->UseRealTime();
+
+// Build and query over each of the scene distributions, performance varies a lot between them.
+static void HTable_Distributions(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0), static_cast<Distribution>(state.range(1)));
+	HTable<scalar_t, index_t, 3> table(vec_t(CellSize), 4);
+
+	PairList<index_t> pairs;
+	for (auto _ : state) {
+		table.build(scene.bounds.data(), scene.size());
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	setItems(state, scene.size());
+	state.counters["pairs"] = static_cast<double>(pairs.size());
+}
+BENCHMARK(HTable_Distributions)->Apply(objectCountsAndDistributions);
+
+static void DVTable_Distributions(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0), static_cast<Distribution>(state.range(1)));
+	DVTable<scalar_t, index_t, 3> table;
+	table.initialize(vec_t(CellSize));
+
+	PairList<index_t> pairs;
+	for (auto _ : state) {
+		table.build(scene.bounds.data(), scene.size());
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	setItems(state, scene.size());
+	state.counters["pairs"] = static_cast<double>(pairs.size());
+}
+BENCHMARK(DVTable_Distributions)->Apply(objectCountsAndDistributions);
+
+static void SortTable_Build(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	SortTable table;
+
+	for (auto _ : state) {
+		table.build(scene.ids.data(), scene.bounds.data(), scene.bounds.size());
+		benchmark::ClobberMemory();
+	}
+	setItems(state, scene.bounds.size());
+}
+BENCHMARK(SortTable_Build)->Apply(objectCounts);
+
+static void SortTable_FindOverlaps(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	SortTable table;
+	table.build(scene.ids.data(), scene.bounds.data(), scene.bounds.size());
+
+	PairList<index_t> pairs;
+	for (auto _ : state) {
+		table.findOverlaps(pairs);
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	setItems(state, scene.bounds.size());
+}
+BENCHMARK(SortTable_FindOverlaps)->Apply(objectCounts);
+
+static void PartitionTable_BuildAndFind(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	PartitionTable<scalar_t, index_t, 3> table(vec_t(CellSize), Encapsulation::Total);
+
+	PairList<index_t> pairs;
+	for (auto _ : state) {
+		table.build(scene.bounds.data(), scene.bounds.size());
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.bounds.size(), pairs);
+		benchmark::DoNotOptimize(pairs.data());
+	}
+	setItems(state, scene.bounds.size());
+}
+BENCHMARK(PartitionTable_BuildAndFind)->Apply(objectCounts);
+
+static void OverlapList_Push(benchmark::State& state) {
+	size_t count = state.range(0);
+	OverlapList list;
+
+	for (auto _ : state) {
+		list.clear();
+		for (size_t i = 0; i < count; i += 8) {
+			list.group();
+			for (index_t j = 0; j < 8; ++j) {
+				list.push(static_cast<index_t>(i) + j);
+			}
+			list.ungroup();
+		}
+		benchmark::ClobberMemory();
+	}
+	setItems(state, count);
+}
+BENCHMARK(OverlapList_Push)->Apply(objectCounts);
+
+static void OverlapList_Iterate(benchmark::State& state) {
+	size_t count = state.range(0);
+	OverlapList list;
+	for (size_t i = 0; i < count; i += 8) {
+		list.group();
+		for (index_t j = 0; j < 8; ++j) {
+			list.pushUnique(static_cast<index_t>(i) + j);
+		}
+		list.ungroup();
+	}
+
+	for (auto _ : state) {
+		int64_t sum = 0;
+		for (auto overlaps : list) {
+			for (index_t id : overlaps) {
+				sum += id;
+			}
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	setItems(state, count);
+}
+BENCHMARK(OverlapList_Iterate)->Apply(objectCounts);
+
+static void Islands_Build(benchmark::State& state) {
+	const Scene& scene = getScene(state.range(0));
+	size_t threads = state.range(1);
+
+	HTable<scalar_t, index_t, 3> table(vec_t(CellSize), 4);
+	table.build(scene.bounds.data(), scene.bounds.size());
+	PairList<index_t> pairs;
+	table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.bounds.size(), pairs);
+
+	ThreadPool pool(threads);
+	Islands<index_t> islands;
+	for (auto _ : state) {
+		islands.build(pairs, scene.ids.size(), pool);
+		benchmark::ClobberMemory();
+	}
+	setItems(state, pairs.size());
+}
+BENCHMARK(Islands_Build)->Apply(objectAndThreadCounts)->UseRealTime();
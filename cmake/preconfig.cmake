@@ -2,4 +2,8 @@
 
 if(NOT TARGET "glm::glm")
 	find_dependency(glm CONFIG)
+endif()
+
+if(NOT TARGET "Threads::Threads")
+	find_dependency(Threads)
 endif()
\ No newline at end of file
@@ -0,0 +1,159 @@
+#pragma once
+#include <cassert>
+#include <cinttypes>
+#include <type_traits>
+#include <pbd/common/BBox.hpp>
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#endif
+
+namespace pbd {
+	// Number of boxes tested at once by the overlap kernel.
+	// Selected at compile time from the widest instruction set enabled for the translation unit.
+#if defined(__AVX512F__)
+	static constexpr int BBoxPackWidth = 16;
+#elif defined(__AVX__)
+	static constexpr int BBoxPackWidth = 8;
+#else
+	static constexpr int BBoxPackWidth = 4;
+#endif
+
+	// Structure of arrays layout for a small batch of bounding boxes.
+	// Used to test a single box against many others with one kernel call.
+	template<glm::length_t L, typename scalar_t, int W = BBoxPackWidth>
+	struct BBoxPack {
+		static_assert(W > 0 && W <= 32, "pbd::BBoxPack width must fit into the returned bitmask!");
+
+		using bbox_t = BBox<L, scalar_t>;
+		static constexpr int Width = W;
+		static constexpr glm::length_t Components = L;
+
+		BBoxPack() noexcept
+			: min{}
+			, max{}
+		{}
+
+		void set(int lane, const bbox_t& box) noexcept {
+			assert(lane >= 0 && lane < Width);
+			for (glm::length_t i = 0; i < L; ++i) {
+				min[i][lane] = box.min[i];
+				max[i][lane] = box.max[i];
+			}
+		}
+
+		// Mask with the first 'count' lanes set.
+		static uint32_t lanes(int count) noexcept {
+			assert(count >= 0 && count <= Width);
+			return count >= 32 ? ~uint32_t(0) : ((uint32_t(1) << count) - 1);
+		}
+
+		alignas(64) scalar_t min[L][W];
+		alignas(64) scalar_t max[L][W];
+	};
+
+	namespace detail {
+		// Scalar fallback, same semantics as BBox::overlaps.
+		template<glm::length_t L, typename scalar_t, int W>
+		uint32_t overlapMaskScalar(const BBox<L, scalar_t>& box, const BBoxPack<L, scalar_t, W>& pack, int first, int last) noexcept {
+			uint32_t mask = 0;
+			for (int j = first; j < last; ++j) {
+				bool sep = false;
+				for (glm::length_t i = 0; i < L; ++i) {
+					sep |= (pack.min[i][j] > box.max[i]) | (pack.max[i][j] < box.min[i]);
+				}
+				mask |= uint32_t(!sep) << j;
+			}
+			return mask;
+		}
+
+		template<glm::length_t L, typename scalar_t, int W>
+		uint32_t overlapMaskSimd(const BBox<L, scalar_t>& box, const BBoxPack<L, scalar_t, W>& pack) noexcept {
+			uint32_t mask = 0;
+			int j = 0;
+#if defined(__AVX512F__)
+			if constexpr (std::is_same_v<scalar_t, float>) {
+				for (; j + 16 <= W; j += 16) {
+					__mmask16 sep = 0;
+					for (glm::length_t i = 0; i < L; ++i) {
+						sep |= _mm512_cmp_ps_mask(_mm512_loadu_ps(pack.min[i] + j), _mm512_set1_ps(box.max[i]), _CMP_GT_OQ);
+						sep |= _mm512_cmp_ps_mask(_mm512_loadu_ps(pack.max[i] + j), _mm512_set1_ps(box.min[i]), _CMP_LT_OQ);
+					}
+					mask |= uint32_t(uint16_t(~sep)) << j;
+				}
+			}
+			else {
+				for (; j + 8 <= W; j += 8) {
+					__mmask8 sep = 0;
+					for (glm::length_t i = 0; i < L; ++i) {
+						sep |= _mm512_cmp_pd_mask(_mm512_loadu_pd(pack.min[i] + j), _mm512_set1_pd(box.max[i]), _CMP_GT_OQ);
+						sep |= _mm512_cmp_pd_mask(_mm512_loadu_pd(pack.max[i] + j), _mm512_set1_pd(box.min[i]), _CMP_LT_OQ);
+					}
+					mask |= uint32_t(uint8_t(~sep)) << j;
+				}
+			}
+#endif
+#if defined(__AVX__)
+			if constexpr (std::is_same_v<scalar_t, float>) {
+				for (; j + 8 <= W; j += 8) {
+					__m256 sep = _mm256_setzero_ps();
+					for (glm::length_t i = 0; i < L; ++i) {
+						sep = _mm256_or_ps(sep, _mm256_cmp_ps(_mm256_loadu_ps(pack.min[i] + j), _mm256_set1_ps(box.max[i]), _CMP_GT_OQ));
+						sep = _mm256_or_ps(sep, _mm256_cmp_ps(_mm256_loadu_ps(pack.max[i] + j), _mm256_set1_ps(box.min[i]), _CMP_LT_OQ));
+					}
+					mask |= uint32_t(~_mm256_movemask_ps(sep) & 0xFF) << j;
+				}
+			}
+			else {
+				for (; j + 4 <= W; j += 4) {
+					__m256d sep = _mm256_setzero_pd();
+					for (glm::length_t i = 0; i < L; ++i) {
+						sep = _mm256_or_pd(sep, _mm256_cmp_pd(_mm256_loadu_pd(pack.min[i] + j), _mm256_set1_pd(box.max[i]), _CMP_GT_OQ));
+						sep = _mm256_or_pd(sep, _mm256_cmp_pd(_mm256_loadu_pd(pack.max[i] + j), _mm256_set1_pd(box.min[i]), _CMP_LT_OQ));
+					}
+					mask |= uint32_t(~_mm256_movemask_pd(sep) & 0xF) << j;
+				}
+			}
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+			if constexpr (std::is_same_v<scalar_t, float>) {
+				for (; j + 4 <= W; j += 4) {
+					__m128 sep = _mm_setzero_ps();
+					for (glm::length_t i = 0; i < L; ++i) {
+						sep = _mm_or_ps(sep, _mm_cmpgt_ps(_mm_loadu_ps(pack.min[i] + j), _mm_set1_ps(box.max[i])));
+						sep = _mm_or_ps(sep, _mm_cmplt_ps(_mm_loadu_ps(pack.max[i] + j), _mm_set1_ps(box.min[i])));
+					}
+					mask |= uint32_t(~_mm_movemask_ps(sep) & 0xF) << j;
+				}
+			}
+			else {
+				for (; j + 2 <= W; j += 2) {
+					__m128d sep = _mm_setzero_pd();
+					for (glm::length_t i = 0; i < L; ++i) {
+						sep = _mm_or_pd(sep, _mm_cmpgt_pd(_mm_loadu_pd(pack.min[i] + j), _mm_set1_pd(box.max[i])));
+						sep = _mm_or_pd(sep, _mm_cmplt_pd(_mm_loadu_pd(pack.max[i] + j), _mm_set1_pd(box.min[i])));
+					}
+					mask |= uint32_t(~_mm_movemask_pd(sep) & 0x3) << j;
+				}
+			}
+#endif
+			if (j < W) {
+				mask |= overlapMaskScalar(box, pack, j, W);
+			}
+			return mask;
+		}
+	}
+
+	// Test one box against every lane of the pack.
+	// Bit j of the result is set when box overlaps lane j, using the same rules as BBox::overlaps.
+	// Lanes that were never set hold stale data, so mask the result with BBoxPack::lanes(count).
+	template<glm::length_t L, typename scalar_t, int W>
+	uint32_t overlapMask(const BBox<L, scalar_t>& box, const BBoxPack<L, scalar_t, W>& pack) noexcept {
+		if constexpr (std::is_same_v<scalar_t, float> || std::is_same_v<scalar_t, double>) {
+			return detail::overlapMaskSimd(box, pack);
+		}
+		else {
+			return detail::overlapMaskScalar(box, pack, 0, W);
+		}
+	}
+}
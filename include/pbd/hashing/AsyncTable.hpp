@@ -0,0 +1,202 @@
+#pragma once
+#include <cinttypes>
+#include <vector>
+#include <array>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cassert>
+#include <utility>
+#include <pbd/hashing/OverlapList.hpp>
+#include <pbd/hashing/OverlapSink.hpp>
+#include <pbd/hashing/Trace.hpp>
+
+namespace pbd {
+	// Double buffered wrapper over a table (DVTable, HTable or DenseTable).
+	// The next table is built on a background thread from a copy of the bounds, while the current one keeps answering queries.
+	// Each table keeps the bounds it was built from, so findOverlaps doesn't need them passed in again.
+	//
+	// Typical frame:
+	//	async.swap();                       // Make last frame's build current, waits if it isn't done yet.
+	//	async.startBuild(bounds, count);    // Start the next one.
+	//	async.findOverlaps(ids, pairs);     // Query the current table while the next one builds.
+	//
+	// The wrapper itself is not thread safe, call it from one thread only.
+	template<typename Table>
+	class AsyncTable {
+	public:
+		using table_t = Table;
+		using index_t = typename table_t::index_t;
+		using bbox_t = typename table_t::bbox_t;
+		using vec_t = typename table_t::vec_t;
+
+		AsyncTable()
+			: AsyncTable(table_t{})
+		{}
+		// Both buffers start as copies of the prototype, use it to pass the grid or the tier count.
+		explicit AsyncTable(const table_t& prototype)
+			: slots{ Slot{ prototype, {} }, Slot{ prototype, {} } }
+			, current(0)
+			, requested(false)
+			, building(false)
+			, stopping(false)
+			, built(false)
+		{}
+		~AsyncTable() {
+			if (worker.joinable()) {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					stopping = true;
+				}
+				wake.notify_all();
+				worker.join();
+			}
+		}
+
+		AsyncTable(const AsyncTable&) = delete;
+		AsyncTable& operator=(const AsyncTable&) = delete;
+
+		// Apply func to both tables, for example to initialize the grid. Waits for the pending build first.
+		template<typename Func>
+		void configure(Func&& func) {
+			wait();
+			func(slots[0].table);
+			func(slots[1].table);
+		}
+
+		// Copy the bounds and start building the next table in the background.
+		// A build that is still running is waited on, a finished one that wasn't swapped in yet is replaced.
+		void startBuild(const bbox_t* const bounds, size_t count) {
+			wait();
+
+			Slot& slot = slots[1 - current];
+			slot.bounds.assign(bounds, bounds + count);
+
+			start();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				requested = true;
+				building = true;
+				built = false;
+			}
+			wake.notify_one();
+		}
+		// Build the next table on the calling thread and make it current.
+		void build(const bbox_t* const bounds, size_t count) {
+			wait();
+
+			Slot& slot = slots[1 - current];
+			slot.bounds.assign(bounds, bounds + count);
+			slot.table.build(slot.bounds.data(), slot.bounds.size());
+			current = 1 - current;
+			built = false;
+		}
+
+		// True while a build is running.
+		bool isBuilding() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			return building;
+		}
+		// True when a finished build is waiting to be swapped in.
+		bool isReady() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			return built;
+		}
+		// Block until the running build is done, if any.
+		void wait() {
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [this]() {
+				return !building;
+			});
+		}
+
+		// Make the last started build current, waiting for it if needed. Only flips an index.
+		// Returns false if there was no build to swap in, the current table stays as it is then.
+		bool swap() {
+			wait();
+			if (!built) {
+				return false;
+			}
+			built = false;
+			current = 1 - current;
+			return true;
+		}
+
+		// The table answering queries, and the bounds it was built from.
+		table_t& table() noexcept {
+			return slots[current].table;
+		}
+		const table_t& table() const noexcept {
+			return slots[current].table;
+		}
+		const std::vector<bbox_t>& bounds() const noexcept {
+			return slots[current].bounds;
+		}
+		size_t size() const noexcept {
+			return slots[current].bounds.size();
+		}
+
+		// Same as the findOverlaps of the table, against the bounds the current table was built from.
+		// The extra arguments (executor, predicate) are passed along.
+		template<typename Output, typename... Args>
+		void findOverlaps(const index_t* const ids, Output& output, Args&&... args) {
+			table().findOverlaps(ids, bounds().data(), size(), output, std::forward<Args>(args)...);
+		}
+		template<typename Visitor, typename... Args>
+		bool forEachOverlap(const index_t* const ids, Visitor&& visitor, Args&&... args) {
+			return table().forEachOverlap(ids, bounds().data(), size(), visitor, std::forward<Args>(args)...);
+		}
+	private:
+		struct Slot {
+			table_t table;
+			std::vector<bbox_t> bounds;
+		};
+
+		// The thread is started on the first background build, so tables only built in place never spawn it.
+		void start() {
+			if (!worker.joinable()) {
+				worker = std::thread([this]() {
+					work();
+				});
+			}
+		}
+		void work() {
+			while (true) {
+				size_t target;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					wake.wait(lock, [this]() {
+						return stopping || requested;
+					});
+					if (stopping) {
+						return;
+					}
+					requested = false;
+					// The current index only changes in swap and build, which wait for this build first.
+					target = 1 - current;
+				}
+
+				{
+					PBD_HASHING_TRACE_SCOPE("AsyncTable::build");
+					Slot& slot = slots[target];
+					slot.table.build(slot.bounds.data(), slot.bounds.size());
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					building = false;
+					built = true;
+				}
+				done.notify_all();
+			}
+		}
+
+		std::array<Slot, 2> slots;
+		size_t current;
+
+		std::thread worker;
+		mutable std::mutex mutex;
+		std::condition_variable wake, done;
+		bool requested, building, stopping, built;
+	};
+}
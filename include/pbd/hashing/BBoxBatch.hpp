@@ -0,0 +1,49 @@
+#pragma once
+#include <pbd/common/BBoxPack.hpp>
+#include <pbd/hashing/util.hpp>
+
+namespace pbd {
+	// Gathers the candidates for a single query box and tests them in batches with overlapMask.
+	// Each candidate carries a tag, which is handed back to the callback for every candidate that overlaps.
+	template<glm::length_t L, typename scalar_t, typename Tag, int W = BBoxPackWidth>
+	class BBoxBatch {
+	public:
+		using bbox_t = BBox<L, scalar_t>;
+		using pack_t = BBoxPack<L, scalar_t, W>;
+		static constexpr int Width = W;
+
+		BBoxBatch()
+			: count(0)
+		{}
+
+		template<typename Func>
+		void add(const bbox_t& box, const bbox_t& candidate, const Tag& tag, Func&& onOverlap) {
+			pack.set(count, candidate);
+			tags[count] = tag;
+			if (++count == Width) {
+				flush(box, onOverlap);
+			}
+		}
+
+		// Must be called once all the candidates for a box have been added.
+		template<typename Func>
+		void flush(const bbox_t& box, Func&& onOverlap) {
+			if (count == 0) {
+				return;
+			}
+			uint32_t mask = overlapMask(box, pack) & pack_t::lanes(count);
+			count = 0;
+			forEachBit(mask, [&](int lane) {
+				onOverlap(tags[lane]);
+			});
+		}
+
+		bool empty() const noexcept {
+			return count == 0;
+		}
+	private:
+		pack_t pack;
+		Tag tags[W];
+		int count;
+	};
+}
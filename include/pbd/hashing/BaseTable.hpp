@@ -1,30 +1,47 @@
 #pragma once
 #include <cinttypes>
 #include <vector>
+#include <array>
 #include <limits>
 #include <cassert>
 #include <pbd/hashing/util.hpp>
+#include <pbd/hashing/Stats.hpp>
+#include <pbd/hashing/Trace.hpp>
 #include <parallel_hashmap/phmap.h>
 
 namespace pbd {
-	template<typename Scalar, typename Index, glm::length_t L, typename Hasher = std::hash<glm::vec<L, Index>>>
+	// Offset is the type of the positions in the entry list stored in the map.
+	// Use a 64 bit offset when the total number of entries can pass the range of the index type,
+	// the ids themselves stay at the index type.
+	template<typename Scalar, typename Index, glm::length_t L, typename Hasher = std::hash<glm::vec<L, Index>>, typename Offset = Index>
 	class BaseTable {
 	public:
 		using scalar_t = Scalar;
 		using index_t = Index;
+		using offset_t = Offset;
 		static constexpr glm::length_t Dims = L;
 		using ivec_t = glm::vec<Dims, index_t>;
 		
-		using map_t = phmap::parallel_flat_hash_map<ivec_t, index_t, Hasher>;
+		using map_t = phmap::parallel_flat_hash_map<ivec_t, offset_t, Hasher>;
 		using map_iter_t = typename map_t::const_iterator;
 		using entries_t = std::vector<index_t>;
 
 		static constexpr ptrdiff_t MaxIndex = std::numeric_limits<index_t>::max();
 		static constexpr ptrdiff_t MinIndex = std::numeric_limits<index_t>::lowest();
+		static constexpr uint64_t MaxOffset = static_cast<uint64_t>(std::numeric_limits<offset_t>::max());
 
 		class CellRange;
 		class const_iterator;
 
+		// Cells are split into 2^Dims batches by the parity of their coordinates.
+		// Two different cells in the same batch never touch, not even diagonally.
+		static constexpr size_t NumParities = size_t(1) << Dims;
+		using parity_batches_t = std::array<std::vector<const_iterator>, NumParities>;
+
+		static size_t parityOf(const ivec_t& cell) noexcept {
+			return pbd::parityOf(cell);
+		}
+
 		void clear() {
 			cellMap.clear();
 			cellEntries.clear();
@@ -53,6 +70,7 @@ namespace pbd {
 			});
 		}
 		void prepareCellEntries(int64_t totalEntries) {
+			PBD_HASHING_TRACE_SCOPE("BaseTable::prefix");
 			cellEntries.resize(totalEntries, 0);
 
 			// Early out.
@@ -63,28 +81,29 @@ namespace pbd {
 			int64_t tot = 0;
 			for (auto& kv : cellMap) {
 				// ecount is the number of entries this cell is going to use, including the first entry that holds ecount-1.
-				index_t ecount = kv.second;
+				offset_t ecount = kv.second;
 
 				// Remap the cell to the current index in the entry list.
-				kv.second = static_cast<index_t>(tot);
+				kv.second = static_cast<offset_t>(tot);
 
 				// Move to the next open position in the entry list.
 				tot += ecount;
-				// Make sure we aren't over the limit.
-				assert(tot < MaxIndex);
+				// Make sure we aren't over the limit, the entries of a single cell are counted with the index type.
+				assert(static_cast<uint64_t>(tot) < MaxOffset);
+				assert(ecount < MaxIndex);
 
 				// First entry is the number of ids in the cell.
-				cellEntries[kv.second] = ecount - 1;
+				cellEntries[kv.second] = static_cast<index_t>(ecount - 1);
 
 				// We use this value in the next step to make sure we insert everything correctly.
-				cellEntries[kv.second + 1] = ecount - 1;
+				cellEntries[kv.second + 1] = static_cast<index_t>(ecount - 1);
 			}
 		}
 		void insert(index_t id, const ivec_t& vec) {
 			assert(cellMap.contains(vec));
 
 			// Grab the index associated with this vec
-			index_t start = cellMap[vec];
+			offset_t start = cellMap[vec];
 
 			// The offset to the end of the cell entries range.
 			index_t& old_offset = cellEntries[start + 1];
@@ -114,6 +133,34 @@ namespace pbd {
 		}
 
 
+		// Group all the occupied cells into checkerboard batches.
+		// The cells of a batch can be processed in parallel, batch after batch, without synchronizing the per cell work.
+		// An object spanning several cells shows up in several cells of the same batch, so a parallel pass over a batch
+		// must not write per object state without synchronization.
+		void parityBatches(parity_batches_t& batches) const {
+			for (auto& batch : batches) {
+				batch.clear();
+			}
+			for (const_iterator it = begin(), last = end(); it != last; ++it) {
+				batches[parityOf(it.cell())].push_back(it);
+			}
+		}
+
+		// Layout of the table after build, see TableStats.
+		// Walks every cell, so it costs about as much as iterating the table.
+		TableStats stats() const {
+			TableStats result;
+			for (const_iterator it = begin(), last = end(); it != last; ++it) {
+				result.addCell(it.range().size());
+			}
+			result.finish();
+
+			result.loadFactor = cellMap.load_factor();
+			// Flat maps store one control byte per slot next to the value.
+			result.bytes = cellMap.capacity() * (sizeof(typename map_t::value_type) + 1) + cellEntries.capacity() * sizeof(index_t);
+			return result;
+		}
+
 		const_iterator begin() const noexcept {
 			return const_iterator(cellMap.begin(), cellEntries);
 		}
@@ -131,7 +178,7 @@ namespace pbd {
 				: mfirst(nullptr)
 				, mlast(nullptr)
 			{}
-			CellRange(const entries_t& list, index_t index)
+			CellRange(const entries_t& list, offset_t index)
 			{
 				mfirst = list.data() + index;
 				mlast = mfirst + (*mfirst);
@@ -139,6 +186,11 @@ namespace pbd {
 				++mfirst;
 				++mlast;
 			}
+			// Plain range of ids, for tables that keep the cell sizes somewhere else.
+			CellRange(const index_t* first, const index_t* last)
+				: mfirst(first)
+				, mlast(last)
+			{}
 
 			explicit operator bool() const noexcept {
 				return !empty();
@@ -0,0 +1,278 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <pbd/common/BBox.hpp>
+
+namespace pbd {
+	// Weights and search range for picking a cell size from a set of bounds.
+	template<typename scalar_t>
+	struct CellSizePolicy {
+		// Relative cost of touching one cell, paid once per entry in build and once per probed cell in findOverlaps.
+		scalar_t cellCost = scalar_t(1);
+		// Relative cost of one candidate overlap test in findOverlaps.
+		scalar_t testCost = scalar_t(1);
+
+		// Number of bounds sampled to estimate the cost, spread evenly over the input.
+		size_t samples = 1024;
+
+		// Cell sizes are searched in multiples of the median box extent, between these two factors.
+		scalar_t minFactor = scalar_t(0.25);
+		scalar_t maxFactor = scalar_t(16);
+		size_t steps = 25;
+
+		// Use the same size on every axis, instead of following the median extent along each axis.
+		bool uniform = false;
+	};
+
+	template<glm::length_t L, typename scalar_t>
+	struct CellSizeChoice {
+		glm::vec<L, scalar_t> cell{ scalar_t(1) };
+		// Number of tiers needed so the largest sampled box fits a single cell, always 1 for flat grids.
+		size_t tiers = 1;
+		// Estimated cost per box, only meaningful relative to other choices for the same bounds.
+		scalar_t cost = scalar_t(0);
+	};
+
+	namespace detail {
+		// Expected cost of a hashed grid for a sample of the bounds.
+		// A box of extent e spans 1 + e/c cells on an axis on average, and the cells it probes hold
+		// about N * (entries per box) * (cell volume) / (domain volume) ids at its tier.
+		// HTable places a box in the tier where it spans at most two cells, and probes every tier above it.
+		template<glm::length_t L, typename scalar_t>
+		class CellSizeModel {
+		public:
+			using bbox_t = BBox<L, scalar_t>;
+			using vec_t = glm::vec<L, scalar_t>;
+
+			CellSizeModel(const bbox_t* const bounds, size_t count, const CellSizePolicy<scalar_t>& _policy)
+				: policy(_policy)
+				, total(static_cast<scalar_t>(count))
+			{
+				assert(count > 0);
+
+				domain = bounds[0];
+				for (size_t i = 1; i < count; ++i) {
+					domain.merge(bounds[i]);
+				}
+
+				size_t nsamples = std::max<size_t>(1, std::min(count, policy.samples));
+				extents.resize(nsamples);
+				for (size_t i = 0; i < nsamples; ++i) {
+					extents[i] = bounds[(i * count) / nsamples].size();
+				}
+			}
+
+			// Cell shape to scale during the search, the median extent along each axis.
+			vec_t baseShape() const {
+				vec_t domainSize = domain.size();
+
+				// Average spacing between the boxes, used for axes where the boxes are flat.
+				scalar_t volume = scalar_t(1);
+				glm::length_t flat = 0;
+				for (glm::length_t i = 0; i < L; ++i) {
+					if (domainSize[i] > scalar_t(0)) {
+						volume *= domainSize[i];
+						++flat;
+					}
+				}
+				scalar_t spacing = flat == 0 ? scalar_t(1) : std::pow(volume / total, scalar_t(1) / static_cast<scalar_t>(flat));
+				spacing = std::max(spacing, MinCell);
+
+				vec_t shape;
+				std::vector<scalar_t> axis(extents.size());
+				for (glm::length_t i = 0; i < L; ++i) {
+					for (size_t j = 0; j < extents.size(); ++j) {
+						axis[j] = extents[j][i];
+					}
+					std::nth_element(axis.begin(), axis.begin() + axis.size() / 2, axis.end());
+					scalar_t median = axis[axis.size() / 2];
+					shape[i] = median > MinCell ? median : spacing;
+				}
+
+				if (policy.uniform) {
+					scalar_t largest = shape[0];
+					for (glm::length_t i = 1; i < L; ++i) {
+						largest = std::max(largest, shape[i]);
+					}
+					shape = vec_t(largest);
+				}
+				return shape;
+			}
+
+			// Tier a box with the given extents lands in, same rule as HTable::classify.
+			static size_t tierOf(const vec_t& extent, const vec_t& cell, size_t ntiers) {
+				scalar_t span = scalar_t(1);
+				for (glm::length_t i = 0; i < L; ++i) {
+					span = std::max(span, scalar_t(1) + extent[i] / cell[i]);
+				}
+				size_t tier = 0;
+				while (span >= scalar_t(2) && tier + 1 < ntiers) {
+					span *= scalar_t(0.5);
+					++tier;
+				}
+				return tier;
+			}
+			// Tiers needed for every sampled box to span at most two cells per axis.
+			size_t tiersNeeded(const vec_t& cell, size_t maxTiers) const {
+				size_t tiers = 1;
+				for (const vec_t& extent : extents) {
+					tiers = std::max(tiers, tierOf(extent, cell, maxTiers) + 1);
+				}
+				return tiers;
+			}
+
+			scalar_t cost(const vec_t& cell, size_t ntiers) const {
+				vec_t domainSize = domain.size();
+
+				// Objects and entries per tier.
+				std::vector<scalar_t> entries(ntiers, scalar_t(0));
+				std::vector<size_t> tiers(extents.size());
+				for (size_t j = 0; j < extents.size(); ++j) {
+					tiers[j] = tierOf(extents[j], cell, ntiers);
+					entries[tiers[j]] += cellsSpanned(extents[j], cell, tiers[j]);
+				}
+
+				// Expected number of ids in a probed cell, per tier.
+				std::vector<scalar_t> density(ntiers);
+				scalar_t scale = total / static_cast<scalar_t>(extents.size());
+				for (size_t t = 0; t < ntiers; ++t) {
+					scalar_t ratio = scalar_t(1);
+					for (glm::length_t i = 0; i < L; ++i) {
+						scalar_t size = cell[i] * static_cast<scalar_t>(size_t(1) << t);
+						// A cell wider than the domain holds the whole domain on that axis.
+						ratio *= std::min(scalar_t(1), size / std::max(domainSize[i], size));
+					}
+					density[t] = entries[t] * scale * ratio;
+				}
+
+				scalar_t sum = scalar_t(0);
+				for (size_t j = 0; j < extents.size(); ++j) {
+					size_t tier = tiers[j];
+					scalar_t probes = scalar_t(0), tests = scalar_t(0);
+					for (size_t t = tier; t < ntiers; ++t) {
+						scalar_t cells = cellsSpanned(extents[j], cell, t);
+						probes += cells;
+						// Only half of the ids in the own tier are tested, the rest test against this box.
+						tests += cells * density[t] * (t == tier ? scalar_t(0.5) : scalar_t(1));
+					}
+					sum += policy.cellCost * (cellsSpanned(extents[j], cell, tier) + probes) + policy.testCost * tests;
+				}
+				return sum / static_cast<scalar_t>(extents.size());
+			}
+		private:
+			static constexpr scalar_t MinCell = scalar_t(1e-4);
+
+			static scalar_t cellsSpanned(const vec_t& extent, const vec_t& cell, size_t tier) {
+				scalar_t factor = static_cast<scalar_t>(size_t(1) << tier);
+				scalar_t cells = scalar_t(1);
+				for (glm::length_t i = 0; i < L; ++i) {
+					cells *= scalar_t(1) + extent[i] / (cell[i] * factor);
+				}
+				return cells;
+			}
+
+			const CellSizePolicy<scalar_t>& policy;
+			scalar_t total;
+			bbox_t domain;
+			std::vector<vec_t> extents;
+		};
+	}
+
+	// Search for the cell size with the lowest expected build and query cost for the bounds.
+	// Pass maxTiers > 1 to size the first tier of an HTable, the choice then includes the tier count.
+	template<glm::length_t L, typename scalar_t>
+	CellSizeChoice<L, scalar_t> chooseCellSize(const BBox<L, scalar_t>* const bounds, size_t count, size_t maxTiers = 1, const CellSizePolicy<scalar_t>& policy = {}) {
+		using vec_t = glm::vec<L, scalar_t>;
+		assert(policy.minFactor > scalar_t(0) && policy.maxFactor >= policy.minFactor);
+
+		CellSizeChoice<L, scalar_t> best;
+		if (count == 0) {
+			return best;
+		}
+		maxTiers = std::max<size_t>(1, maxTiers);
+
+		detail::CellSizeModel<L, scalar_t> model(bounds, count, policy);
+		vec_t shape = model.baseShape();
+
+		best.cost = std::numeric_limits<scalar_t>::max();
+		size_t steps = std::max<size_t>(2, policy.steps);
+		scalar_t ratio = std::pow(policy.maxFactor / policy.minFactor, scalar_t(1) / static_cast<scalar_t>(steps - 1));
+		scalar_t factor = policy.minFactor;
+		for (size_t i = 0; i < steps; ++i, factor *= ratio) {
+			vec_t cell = shape * factor;
+			size_t tiers = model.tiersNeeded(cell, maxTiers);
+			scalar_t cost = model.cost(cell, tiers);
+			if (cost < best.cost) {
+				best.cell = cell;
+				best.tiers = tiers;
+				best.cost = cost;
+			}
+		}
+		return best;
+	}
+
+	// Re-runs the cell size search every few frames, for scenes where the size distribution drifts.
+	// Reports a change only when the cell size moved by more than the threshold, so the tables aren't rebuilt on noise.
+	template<glm::length_t L, typename scalar_t>
+	class CellSizeTuner {
+	public:
+		using bbox_t = BBox<L, scalar_t>;
+		using choice_t = CellSizeChoice<L, scalar_t>;
+
+		CellSizeTuner(size_t _interval = 60, scalar_t _threshold = scalar_t(0.25), const CellSizePolicy<scalar_t>& _policy = {})
+			: policy(_policy)
+			, interval(std::max<size_t>(1, _interval))
+			, threshold(_threshold)
+			, frame(0)
+			, valid(false)
+		{}
+
+		// Call once per frame. Returns true when a new cell size was chosen, re-initialize the table with choice() then.
+		bool update(const bbox_t* const bounds, size_t count, size_t maxTiers = 1) {
+			bool due = !valid || (++frame >= interval);
+			if (!due || count == 0) {
+				return false;
+			}
+			frame = 0;
+
+			choice_t next = chooseCellSize(bounds, count, maxTiers, policy);
+			if (valid && next.tiers == current.tiers && !changed(current.cell, next.cell)) {
+				return false;
+			}
+			current = next;
+			valid = true;
+			return true;
+		}
+
+		const choice_t& choice() const noexcept {
+			return current;
+		}
+		bool hasChoice() const noexcept {
+			return valid;
+		}
+		void reset() noexcept {
+			frame = 0;
+			valid = false;
+		}
+	private:
+		bool changed(const glm::vec<L, scalar_t>& a, const glm::vec<L, scalar_t>& b) const {
+			for (glm::length_t i = 0; i < L; ++i) {
+				if (std::abs(b[i] - a[i]) > threshold * a[i]) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		CellSizePolicy<scalar_t> policy;
+		size_t interval;
+		scalar_t threshold;
+		size_t frame;
+		bool valid;
+		choice_t current;
+	};
+}
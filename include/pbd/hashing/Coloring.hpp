@@ -0,0 +1,416 @@
+#pragma once
+#include <cinttypes>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <pbd/hashing/util.hpp>
+#include <pbd/hashing/Executor.hpp>
+#include <pbd/hashing/OverlapList.hpp>
+#include <pbd/hashing/OverlapSink.hpp>
+
+namespace pbd {
+	// Colors the constraints (overlapping pairs) so that no two constraints of the same color share a body.
+	// Each color is a batch that can be projected in parallel without atomics, one batch after another.
+	//
+	// Uses Jones-Plassmann: every round, the uncolored constraints with the highest priority among their uncolored neighbors
+	// take the smallest color not used by their neighbors. The selected constraints are never adjacent, so each round runs in parallel.
+	// recolor() seeds the constraints that persist from the previous frame with their old color, so batches stay stable over time.
+	template<typename Index = int32_t>
+	class ConstraintColoring {
+	public:
+		using index_t = Index;
+		using pair_t = std::pair<index_t, index_t>;
+
+		class Batch;
+
+		// Color from scratch. Bodies are the ids in the range [0, nbodies).
+		// The thread count versions run on ThreadPool::global(), the others take any executor, see Executor.hpp.
+		void build(const PairList<index_t>& pairs, size_t nbodies, size_t threads = 1) {
+			build(pairs, nbodies, detail::ThreadCountExecutor(threads));
+		}
+		void build(const OverlapList& list, size_t nbodies, size_t threads = 1) {
+			build(list, nbodies, detail::ThreadCountExecutor(threads));
+		}
+		template<typename Executor, detail::enable_if_executor_t<Executor> = 0>
+		void build(const PairList<index_t>& pairs, size_t nbodies, Executor&& executor) {
+			history.clear();
+			recolor(pairs, nbodies, executor);
+		}
+		template<typename Executor, detail::enable_if_executor_t<Executor> = 0>
+		void build(const OverlapList& list, size_t nbodies, Executor&& executor) {
+			expand(list);
+			build(scratchPairs, nbodies, executor);
+		}
+
+		// Color using the previous frame's colors as a starting point.
+		void recolor(const PairList<index_t>& pairs, size_t nbodies, size_t threads = 1) {
+			recolor(pairs, nbodies, detail::ThreadCountExecutor(threads));
+		}
+		void recolor(const OverlapList& list, size_t nbodies, size_t threads = 1) {
+			recolor(list, nbodies, detail::ThreadCountExecutor(threads));
+		}
+		template<typename Executor, detail::enable_if_executor_t<Executor> = 0>
+		void recolor(const PairList<index_t>& pairs, size_t nbodies, Executor&& executor) {
+			constraints = pairs.data();
+			nconstraints = pairs.size();
+
+			buildIncidence(nbodies);
+			seed(executor);
+			colorRounds(executor);
+			if (balanced) {
+				balance();
+			}
+			buildBatches();
+			remember();
+		}
+		template<typename Executor, detail::enable_if_executor_t<Executor> = 0>
+		void recolor(const OverlapList& list, size_t nbodies, Executor&& executor) {
+			expand(list);
+			recolor(scratchPairs, nbodies, executor);
+		}
+
+		// Move constraints from oversized colors into smaller ones after coloring, so batch sizes are closer to equal.
+		void setBalanced(bool value) noexcept {
+			balanced = value;
+		}
+		bool isBalanced() const noexcept {
+			return balanced;
+		}
+
+		void clear() {
+			nconstraints = 0;
+			colors.clear();
+			batchOffsets.clear();
+			batchConstraints.clear();
+			history.clear();
+		}
+
+		size_t numColors() const noexcept {
+			return batchOffsets.empty() ? 0 : batchOffsets.size() - 1;
+		}
+		size_t size() const noexcept {
+			return nconstraints;
+		}
+
+		// The constraint indices (into the pair list) that share the given color.
+		Batch operator[](size_t color) const noexcept {
+			assert(color < numColors());
+			return Batch(batchConstraints.data() + batchOffsets[color], batchConstraints.data() + batchOffsets[color + 1]);
+		}
+		index_t colorOf(size_t constraint) const noexcept {
+			assert(constraint < nconstraints);
+			return colors[constraint];
+		}
+
+		class Batch {
+		public:
+			Batch(const index_t* _first, const index_t* _last)
+				: mfirst(_first)
+				, mlast(_last)
+			{}
+
+			size_t size() const noexcept {
+				return mlast - mfirst;
+			}
+			bool empty() const noexcept {
+				return mfirst == mlast;
+			}
+
+			const index_t& operator[](int32_t i) const noexcept {
+				assert(i >= 0 && i < size());
+				return mfirst[i];
+			}
+
+			const index_t* begin() const noexcept {
+				return mfirst;
+			}
+			const index_t* end() const noexcept {
+				return mlast;
+			}
+		private:
+			const index_t* mfirst, * mlast;
+		};
+	private:
+		static constexpr index_t Uncolored = -1;
+
+		static uint64_t keyOf(const pair_t& pair) noexcept {
+			index_t a = std::min(pair.first, pair.second);
+			index_t b = std::max(pair.first, pair.second);
+			return (uint64_t(static_cast<uint32_t>(a)) << 32) | uint64_t(static_cast<uint32_t>(b));
+		}
+		// Pseudo random priority derived from the pair, so it stays the same from frame to frame. Ties are broken by index.
+		static uint64_t priorityOf(const pair_t& pair) noexcept {
+			uint64_t x = keyOf(pair);
+			x ^= x >> 33;
+			x *= 0xff51afd7ed558ccdull;
+			x ^= x >> 33;
+			x *= 0xc4ceb9fe1a85ec53ull;
+			x ^= x >> 33;
+			return x;
+		}
+		bool before(size_t a, size_t b) const noexcept {
+			return priorities[a] > priorities[b] || (priorities[a] == priorities[b] && a < b);
+		}
+
+		template<typename Func>
+		void forEachNeighbor(size_t c, Func&& func) const {
+			const pair_t& pair = constraints[c];
+			for (index_t body : { pair.first, pair.second }) {
+				for (index_t i = incidenceOffsets[body], last = incidenceOffsets[body + 1]; i < last; ++i) {
+					index_t other = incidence[i];
+					if (static_cast<size_t>(other) != c) {
+						func(other);
+					}
+				}
+			}
+		}
+
+		void expand(const OverlapList& list) {
+			scratchPairs.clear();
+			scratchPairs.reserve(list.numPairs());
+			for (auto overlaps : list) {
+				index_t first = static_cast<index_t>(overlaps.front());
+				for (size_t i = 1; i < overlaps.size(); ++i) {
+					scratchPairs.emplace_back(first, static_cast<index_t>(overlaps[i]));
+				}
+			}
+		}
+
+		// Body to constraint adjacency, as compressed rows.
+		void buildIncidence(size_t nbodies) {
+			incidenceOffsets.clear();
+			incidenceOffsets.resize(nbodies + 1, 0);
+			for (size_t c = 0; c < nconstraints; ++c) {
+				assert(constraints[c].first >= 0 && static_cast<size_t>(constraints[c].first) < nbodies);
+				assert(constraints[c].second >= 0 && static_cast<size_t>(constraints[c].second) < nbodies);
+				++incidenceOffsets[constraints[c].first + 1];
+				++incidenceOffsets[constraints[c].second + 1];
+			}
+			maxDegree = 0;
+			for (size_t i = 1; i <= nbodies; ++i) {
+				maxDegree = std::max<size_t>(maxDegree, incidenceOffsets[i]);
+				incidenceOffsets[i] += incidenceOffsets[i - 1];
+			}
+
+			incidence.resize(nconstraints * 2);
+			std::vector<index_t> cursor(incidenceOffsets.begin(), incidenceOffsets.end() - 1);
+			for (size_t c = 0; c < nconstraints; ++c) {
+				incidence[cursor[constraints[c].first]++] = static_cast<index_t>(c);
+				incidence[cursor[constraints[c].second]++] = static_cast<index_t>(c);
+			}
+
+			priorities.resize(nconstraints);
+			for (size_t c = 0; c < nconstraints; ++c) {
+				priorities[c] = priorityOf(constraints[c]);
+			}
+		}
+
+		// Give the persisting constraints their previous color, unless a higher priority neighbor claims the same one.
+		template<typename Executor>
+		void seed(Executor& executor) {
+			colors.assign(nconstraints, Uncolored);
+			if (history.empty()) {
+				return;
+			}
+
+			std::vector<index_t>& previous = scratchColors;
+			previous.assign(nconstraints, Uncolored);
+
+			order.resize(nconstraints);
+			for (size_t c = 0; c < nconstraints; ++c) {
+				order[c] = static_cast<index_t>(c);
+			}
+			std::sort(order.begin(), order.end(), [&](index_t a, index_t b) {
+				return keyOf(constraints[a]) < keyOf(constraints[b]);
+			});
+
+			auto hist = history.begin(), histEnd = history.end();
+			for (index_t c : order) {
+				uint64_t key = keyOf(constraints[c]);
+				while (hist != histEnd && hist->first < key) {
+					++hist;
+				}
+				if (hist != histEnd && hist->first == key) {
+					previous[c] = hist->second;
+				}
+			}
+
+			detail::parallelRanges(executor, nconstraints, executor.concurrency(), [&](size_t first, size_t last, size_t) {
+				for (size_t c = first; c < last; ++c) {
+					index_t color = previous[c];
+					if (color == Uncolored) {
+						continue;
+					}
+					bool keep = true;
+					forEachNeighbor(c, [&](index_t other) {
+						keep &= !(previous[other] == color && before(other, c));
+					});
+					if (keep) {
+						colors[c] = color;
+					}
+				}
+			});
+		}
+
+		template<typename Executor>
+		void colorRounds(Executor& executor) {
+			uncolored.clear();
+			for (size_t c = 0; c < nconstraints; ++c) {
+				if (colors[c] == Uncolored) {
+					uncolored.push_back(static_cast<index_t>(c));
+				}
+			}
+
+			// Per part flags for finding the smallest free color, a constraint can't have more neighbors than this.
+			size_t parts = std::max<size_t>(1, executor.concurrency());
+			std::vector<std::vector<uint8_t>> used(parts);
+			for (auto& flags : used) {
+				flags.assign(maxDegree * 2 + 1, 0);
+			}
+
+			while (!uncolored.empty()) {
+				// Select the local maxima among the uncolored constraints.
+				selected.assign(uncolored.size(), 0);
+				detail::parallelRanges(executor, uncolored.size(), parts, [&](size_t first, size_t last, size_t) {
+					for (size_t i = first; i < last; ++i) {
+						index_t c = uncolored[i];
+						bool best = true;
+						forEachNeighbor(c, [&](index_t other) {
+							best &= !(colors[other] == Uncolored && before(other, c));
+						});
+						selected[i] = best;
+					}
+				});
+
+				// None of the selected constraints are adjacent, so they can all be colored at once.
+				detail::parallelRanges(executor, uncolored.size(), parts, [&](size_t first, size_t last, size_t part) {
+					std::vector<uint8_t>& flags = used[part];
+					for (size_t i = first; i < last; ++i) {
+						if (!selected[i]) {
+							continue;
+						}
+						index_t c = uncolored[i];
+						forEachNeighbor(c, [&](index_t other) {
+							index_t color = colors[other];
+							if (color != Uncolored && static_cast<size_t>(color) < flags.size()) {
+								flags[color] = 1;
+							}
+						});
+						index_t color = 0;
+						while (flags[color]) {
+							++color;
+						}
+						forEachNeighbor(c, [&](index_t other) {
+							index_t color = colors[other];
+							if (color != Uncolored && static_cast<size_t>(color) < flags.size()) {
+								flags[color] = 0;
+							}
+						});
+						colors[c] = color;
+					}
+				});
+
+				size_t remaining = 0;
+				for (size_t i = 0; i < uncolored.size(); ++i) {
+					if (!selected[i]) {
+						uncolored[remaining++] = uncolored[i];
+					}
+				}
+				uncolored.resize(remaining);
+			}
+		}
+
+		// Greedily move constraints out of the colors above the average size.
+		void balance() {
+			index_t ncolors = 0;
+			for (size_t c = 0; c < nconstraints; ++c) {
+				ncolors = std::max(ncolors, colors[c] + 1);
+			}
+			if (ncolors < 2) {
+				return;
+			}
+
+			std::vector<size_t> counts(ncolors, 0);
+			for (size_t c = 0; c < nconstraints; ++c) {
+				++counts[colors[c]];
+			}
+			size_t target = (nconstraints + ncolors - 1) / ncolors;
+
+			std::vector<uint8_t> flags(ncolors, 0);
+			for (size_t c = 0; c < nconstraints; ++c) {
+				index_t color = colors[c];
+				if (counts[color] <= target) {
+					continue;
+				}
+
+				forEachNeighbor(c, [&](index_t other) {
+					flags[colors[other]] = 1;
+				});
+
+				index_t best = Uncolored;
+				for (index_t i = 0; i < ncolors; ++i) {
+					if (!flags[i] && counts[i] < target && (best == Uncolored || counts[i] < counts[best])) {
+						best = i;
+					}
+				}
+
+				forEachNeighbor(c, [&](index_t other) {
+					flags[colors[other]] = 0;
+				});
+
+				if (best != Uncolored) {
+					--counts[color];
+					++counts[best];
+					colors[c] = best;
+				}
+			}
+		}
+
+		void buildBatches() {
+			index_t ncolors = 0;
+			for (size_t c = 0; c < nconstraints; ++c) {
+				ncolors = std::max(ncolors, colors[c] + 1);
+			}
+
+			batchOffsets.clear();
+			batchOffsets.resize(ncolors + 1, 0);
+			for (size_t c = 0; c < nconstraints; ++c) {
+				++batchOffsets[colors[c] + 1];
+			}
+			for (index_t i = 1; i <= ncolors; ++i) {
+				batchOffsets[i] += batchOffsets[i - 1];
+			}
+
+			batchConstraints.resize(nconstraints);
+			std::vector<index_t> cursor(batchOffsets.begin(), batchOffsets.end() - 1);
+			for (size_t c = 0; c < nconstraints; ++c) {
+				batchConstraints[cursor[colors[c]]++] = static_cast<index_t>(c);
+			}
+		}
+
+		// Store the colors by pair, sorted, for the next call to recolor.
+		void remember() {
+			history.resize(nconstraints);
+			for (size_t c = 0; c < nconstraints; ++c) {
+				history[c] = { keyOf(constraints[c]), colors[c] };
+			}
+			std::sort(history.begin(), history.end());
+		}
+
+		const pair_t* constraints = nullptr;
+		size_t nconstraints = 0;
+		size_t maxDegree = 0;
+		bool balanced = true;
+
+		std::vector<index_t> incidenceOffsets, incidence;
+		std::vector<uint64_t> priorities;
+
+		std::vector<index_t> colors;
+		std::vector<index_t> uncolored, order, scratchColors;
+		std::vector<uint8_t> selected;
+		PairList<index_t> scratchPairs;
+
+		std::vector<index_t> batchOffsets, batchConstraints;
+		std::vector<std::pair<uint64_t, index_t>> history;
+	};
+}
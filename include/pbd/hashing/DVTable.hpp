@@ -2,37 +2,68 @@
 #include <pbd/hashing/Grid.hpp>
 #include <pbd/common/BBox.hpp>
 #include <pbd/hashing/BaseTable.hpp>
+#include <pbd/hashing/BBoxBatch.hpp>
+#include <pbd/hashing/OverlapList.hpp>
+#include <pbd/hashing/OverlapSink.hpp>
+#include <pbd/hashing/Executor.hpp>
+#include <pbd/hashing/Predicates.hpp>
+#include <pbd/hashing/Trace.hpp>
 
 namespace pbd {
 	// Dynamically sized vector hash table.
 	// This is a true hash table, not just a grid method.
 	// Grid based methods are essentially just a fancy radix sort.
-	template<typename Scalar, typename Index, glm::length_t L>
+	// The grid is a policy, any of Grid, UniformGrid or Pow2Grid can be used.
+	// Offset is the type of the positions in the entry list, see BaseTable.
+	template<typename Scalar, typename Index, glm::length_t L, typename GridType = Grid<Index, L, Scalar>, typename Offset = Index>
 	class DVTable {
 	public:
 		using scalar_t = Scalar;
 		using index_t = Index;
+		using offset_t = Offset;
 		static constexpr glm::length_t Dims = L;
-		using grid_t = Grid<index_t, Dims, scalar_t>;
+		using grid_t = GridType;
 		using bbox_t = BBox<Dims, scalar_t>;
 		using vec_t = typename grid_t::vec_t;
 		using ivec_t = typename grid_t::ivec_t;
+		static_assert(std::is_same_v<vec_t, glm::vec<Dims, scalar_t>> && std::is_same_v<ivec_t, glm::vec<Dims, index_t>>, "pbd::DVTable grid must use the same scalar, index and dimensions as the table!");
 
-		using subtable_t = BaseTable<scalar_t, index_t, Dims>;
+		using subtable_t = BaseTable<scalar_t, index_t, Dims, std::hash<ivec_t>, offset_t>;
 		using const_iterator = typename subtable_t::const_iterator;
 		using CellRange = typename subtable_t::CellRange;
+		using parity_batches_t = typename subtable_t::parity_batches_t;
+		static constexpr size_t NumParities = subtable_t::NumParities;
 
 		void initialize(const grid_t& _grid) {
 			grid = _grid;
+			initialized = true;
 		}
 		void initialize(const vec_t& _cell_size) {
-			grid = grid_t(_cell_size);
+			initialize(grid_t(_cell_size));
+		}
+		// Pick the cell size from the bounds, see chooseCellSize.
+		void initialize(const bbox_t* const bounds, size_t count, const CellSizePolicy<scalar_t>& policy = {}) {
+			initialize(grid_t::fromBounds(bounds, count, policy));
+		}
+
+		// True once one of the initialize functions was called. Grid policies without parameters, like Pow2Grid, don't need it.
+		bool isInitialized() const noexcept {
+			return initialized;
 		}
 
 		const grid_t& getGrid() const {
 			return grid;
 		}
 
+		// Move the grid origin next to the anchor, see Grid::rebase. Only the Grid policy has an origin.
+		// The table is cleared and has to be rebuilt.
+		void rebase(const vec_t& anchor) {
+			static_assert(detail::HasOrigin<grid_t>::value, "pbd::DVTable::rebase needs a grid policy with an origin, use Grid!");
+			assert(isInitialized());
+			grid.rebase(anchor);
+			clear();
+		}
+
 		void clear() {
 			table.clear();
 		}
@@ -40,116 +71,236 @@ namespace pbd {
 
 		// Build from a set of bounding boxes
 		void build(const index_t* const ids, const bbox_t* const bounds, size_t count) {
-			table.clear();
+			buildBounds(bounds, count, [ids](size_t i) { return ids[i]; });
+		}
+		void build(const bbox_t* const bounds, size_t count) {
+			buildBounds(bounds, count, [](size_t i) { return static_cast<index_t>(i); });
+		}
 
-			int64_t totalEntries = 0;
-			const bbox_t* boxit = bounds;
-			const bbox_t* boxend = bounds + count;
-			for (; boxit != boxend; ++boxit) {
-				ivec_t b0 = grid.calcCell(boxit->min);
-				ivec_t b1 = grid.calcCell(boxit->max);
-				table.count(b0, b1, totalEntries);
-			}
+		// Build from a set of points
+		void build(const index_t* const ids, const vec_t* const points, size_t count) {
+			buildPoints(points, count, [ids](size_t i) { return ids[i]; });
+		}
+		void build(const vec_t* const points, size_t count) {
+			buildPoints(points, count, [](size_t i) { return static_cast<index_t>(i); });
+		}
 
-			table.prepareCellEntries(totalEntries);
+		// Find all the overlapping pairs among a set of bounding boxes.
+		// The table must have been built from the same bounds with build(bounds, count), so the entries are indices into them.
+		// Each group in the list starts with the id of a box, followed by the ids of the boxes it overlaps.
+		// The predicate filters the pairs after the box test, see HTable::findOverlaps.
+		template<typename Predicate = BoxOverlap, detail::enable_if_predicate_t<Predicate, index_t> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapList& list, const Predicate& predicate = {}) const {
+			list.clear();
 
-			boxit = bounds;
-			for (const index_t* idit = ids; boxit != boxend; ++boxit, ++idit) {
-				ivec_t b0 = grid.calcCell(boxit->min);
-				ivec_t b1 = grid.calcCell(boxit->max);
-				table.insert(*idit, b0, b1);
-			}
+			detail::OverlapListSink sink{ list };
+			findOverlapsSerial(ids, bounds, count, sink, predicate);
 		}
-		void build(const bbox_t* const bounds, size_t count) {
-			table.clear();
+		// Same as above, but writes each pair directly into a flat list.
+		// The list is cleared first, its capacity is kept so it can be reused from frame to frame.
+		template<typename Predicate = BoxOverlap, detail::enable_if_predicate_t<Predicate, index_t> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, PairList<index_t>& pairs, const Predicate& predicate = {}) const {
+			pairs.clear();
 
-			int64_t totalEntries = 0;
-			const bbox_t* boxit = bounds;
-			const bbox_t* boxend = bounds + count;
-			for (; boxit != boxend; ++boxit) {
-				ivec_t b0 = grid.calcCell(boxit->min);
-				ivec_t b1 = grid.calcCell(boxit->max);
-				table.count(b0, b1, totalEntries);
-			}
+			detail::PairListSink<index_t> sink{ pairs, 0 };
+			findOverlapsSerial(ids, bounds, count, sink, predicate);
+		}
+		// Same as above, but writes a symmetric adjacency indexed by the ids.
+		template<typename Predicate = BoxOverlap, detail::enable_if_predicate_t<Predicate, index_t> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapCSR<index_t>& csr, const Predicate& predicate = {}) const {
+			auto& pairs = csr.scratch();
+			findOverlaps(ids, bounds, count, pairs, predicate);
+			csr.assign(pairs, detail::vertexCount(ids, count));
+		}
 
-			table.prepareCellEntries(totalEntries);
+		// Visit the overlapping pairs without storing them, see HTable::forEachOverlap.
+		template<typename Visitor, typename Predicate = BoxOverlap>
+		bool forEachOverlap(const index_t* const ids, const bbox_t* const bounds, size_t count, Visitor&& visitor, const Predicate& predicate = {}) const {
+			detail::VisitorSink<index_t, std::remove_reference_t<Visitor>> sink{ visitor, 0, false };
+			findOverlapsSerial(ids, bounds, count, sink, predicate);
+			return !sink.done();
+		}
 
-			int i = 0;
-			boxit = bounds;
-			while (boxit != boxend) {
-				ivec_t b0 = grid.calcCell(boxit->min);
-				ivec_t b1 = grid.calcCell(boxit->max);
-				table.insert(i, b0, b1);
+		// Same as the above, with the boxes split into parts that run through the executor, see Executor.hpp.
+		// The output is the same as the serial version. The table itself is only read.
+		template<typename Executor, typename Predicate = BoxOverlap, detail::enable_if_executor_t<Executor> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapList& list, Executor&& executor, const Predicate& predicate = {}) const {
+			findOverlapsParallel(ids, bounds, count, list, executor, predicate);
+		}
+		template<typename Executor, typename Predicate = BoxOverlap, detail::enable_if_executor_t<Executor> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, PairList<index_t>& pairs, Executor&& executor, const Predicate& predicate = {}) const {
+			findOverlapsParallel(ids, bounds, count, pairs, executor, predicate);
+		}
+		template<typename Executor, typename Predicate = BoxOverlap, detail::enable_if_executor_t<Executor> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapCSR<index_t>& csr, Executor&& executor, const Predicate& predicate = {}) const {
+			auto& pairs = csr.scratch();
+			findOverlapsParallel(ids, bounds, count, pairs, executor, predicate);
+			csr.assign(pairs, detail::vertexCount(ids, count));
+		}
 
-				++boxit;
-				++i;
-			}
+		CellRange find(const vec_t& point) const {
+			return table.find(grid.calcCell(point));
 		}
 
-		// Build from a set of points
-		void build(const index_t* const ids, const vec_t* const points, size_t count) {
-			clear();
+		// Occupied cells grouped into 2^Dims batches, see BaseTable::parityBatches.
+		void parityBatches(parity_batches_t& batches) const {
+			table.parityBatches(batches);
+		}
+
+		const_iterator begin() const {
+			return table.begin();
+		}
+		const_iterator end() const {
+			return table.end();
+		}
+
+		size_t numCells() const {
+			return table.numCells();
+		}
+
+		// Layout of the table after build, along with the counters of the last findOverlaps call.
+		TableStats stats() const {
+			TableStats result = table.stats();
+			result.queries = queries;
+			return result;
+		}
+	private:
+		// The cells are computed once in a batch, then used by both the count and the insert passes.
+		template<typename IdFunc>
+		void buildBounds(const bbox_t* const bounds, size_t count, IdFunc&& idOf) {
+			table.clear();
+
+			lows.resize(count);
+			highs.resize(count);
+			grid.calcBounds(bounds, count, lows.data(), highs.data());
 
 			int64_t totalEntries = 0;
-			const vec_t* pit = points;
-			const vec_t* pend = points + count;
-			for (; pit != pend; ++pit) {
-				ivec_t vec = grid.calcCell(*pit);
-				table.count(vec, totalEntries);
+			{
+				PBD_HASHING_TRACE_SCOPE("DVTable::count");
+				for (size_t i = 0; i < count; ++i) {
+					table.count(lows[i], highs[i], totalEntries);
+				}
 			}
 
 			table.prepareCellEntries(totalEntries);
 
-			pit = points;
-			const index_t* idit = ids;
-			while(pit != pend) {
-				ivec_t vec = grid.calcCell(*pit);
-				table.insert(*idit, vec);
-
-				++pit;
-				++idit;
+			PBD_HASHING_TRACE_SCOPE("DVTable::insert");
+			for (size_t i = 0; i < count; ++i) {
+				table.insert(idOf(i), lows[i], highs[i]);
 			}
 		}
-		void build(const vec_t* const points, size_t count) {
+		template<typename IdFunc>
+		void buildPoints(const vec_t* const points, size_t count, IdFunc&& idOf) {
 			clear();
 
+			lows.resize(count);
+			grid.calcCells(points, count, lows.data());
+
 			int64_t totalEntries = 0;
-			const vec_t* pit = points;
-			const vec_t* pend = points + count;
-			for (; pit != pend; ++pit) {
-				ivec_t vec = grid.calcCell(*pit);
-				table.count(vec, totalEntries);
+			{
+				PBD_HASHING_TRACE_SCOPE("DVTable::count");
+				for (size_t i = 0; i < count; ++i) {
+					table.count(lows[i], totalEntries);
+				}
 			}
 
 			table.prepareCellEntries(totalEntries);
 
-			int i = 0;
-			pit = points;
-			while (pit != pend) {
-				ivec_t vec = grid.calcCell(*pit);
-				table.insert(i, vec);
-
-				++pit;
-				++i;
+			PBD_HASHING_TRACE_SCOPE("DVTable::insert");
+			for (size_t i = 0; i < count; ++i) {
+				table.insert(idOf(i), lows[i]);
 			}
 		}
 
-		CellRange find(const vec_t& point) const {
-			return table.find(grid.calcCell(point));
+		template<typename Sink, typename Predicate>
+		void findOverlapsSerial(const index_t* const ids, const bbox_t* const bounds, size_t count, Sink& sink, const Predicate& predicate) const {
+			PBD_HASHING_TRACE_SCOPE("DVTable::findOverlaps");
+			QueryStats counters;
+			findOverlapsImpl(ids, bounds, 0, count, sink, predicate, counters);
+			PBD_HASHING_STAT(queries = counters);
 		}
+		template<typename Output, typename Executor, typename Predicate>
+		void findOverlapsParallel(const index_t* const ids, const bbox_t* const bounds, size_t count, Output& output, Executor& executor, const Predicate& predicate) const {
+			// A single thread gains nothing from the parts, query straight into the output.
+			if (executor.concurrency() <= 1) {
+				detail::serialQuery(output, [&](auto& sink) {
+					findOverlapsSerial(ids, bounds, count, sink, predicate);
+				});
+				return;
+			}
 
-		const_iterator begin() const {
-			return table.begin();
-		}
-		const_iterator end() const {
-			return table.end();
+			PBD_HASHING_TRACE_SCOPE("DVTable::findOverlaps");
+			// Outputs of the parts are allocated per call, so concurrent queries on the same table share nothing.
+			detail::PartitionedQuery<index_t> partitioned;
+			QueryStats counters = partitioned.run(executor, count, output, [&](size_t first, size_t last, auto& sink, QueryStats& partCounters) {
+				findOverlapsImpl(ids, bounds, first, last, sink, predicate, partCounters);
+			});
+			PBD_HASHING_STAT(queries = counters);
 		}
 
-		size_t numCells() const {
-			return table.numCells();
+		// Queries the boxes [first, last), the pairs are only checked against lower indices so every box has to be in the table.
+		template<typename Sink, typename Predicate>
+		void findOverlapsImpl(const index_t* const ids, const bbox_t* const bounds, size_t first, size_t last, Sink& sink, const Predicate& predicate, QueryStats& result) const {
+
+			// Same approach as the HTable, with a single tier.
+			// Pairs are only reported from the cell containing the max of the two mins, so shared cells don't produce duplicates.
+			// The check only needs the two mins, so it runs before the box test.
+			struct Candidate {
+				index_t cid;
+			};
+			BBoxBatch<Dims, scalar_t, Candidate> batch;
+			PBD_HASHING_STAT(QueryStats counters);
+
+			for (size_t bidx = first; bidx < last && !sink.done(); ++bidx) {
+				const bbox_t& bbox = bounds[bidx];
+
+				auto onOverlap = [&](const Candidate& cand) {
+					if (predicate(static_cast<index_t>(bidx), cand.cid)) {
+						sink.add(ids[cand.cid]);
+						PBD_HASHING_STAT(++counters.accepted);
+					}
+					else {
+						PBD_HASHING_STAT(++counters.rejected);
+					}
+				};
+
+				sink.begin(ids[bidx]);
+
+				ivec_t b0 = grid.calcCell(bbox.min);
+				ivec_t b1 = grid.calcCell(bbox.max);
+				applyAllCells(b0, b1, [&](const ivec_t& loc) {
+					if (sink.done()) {
+						return;
+					}
+					for (index_t cid : table.find(loc)) {
+						// Ignore any ids greater than the box id, to make sure we only add a pairing once.
+						if (cid >= static_cast<index_t>(bidx)) {
+							continue;
+						}
+						// Another shared cell reports the pair.
+						if (grid.calcCell(glm::max(bbox.min, bounds[cid].min)) != loc) {
+							PBD_HASHING_STAT(++counters.duplicates);
+							continue;
+						}
+						PBD_HASHING_STAT(++counters.candidates);
+						batch.add(bbox, bounds[cid], Candidate{ cid }, onOverlap);
+					}
+				});
+
+				batch.flush(bbox, onOverlap);
+				sink.end();
+			}
+
+			PBD_HASHING_STAT(result += counters);
 		}
-	private:
+
 		grid_t grid;
+		bool initialized = false;
 		subtable_t table;
+		// Cells of the last build, kept so the memory is reused.
+		std::vector<ivec_t> lows, highs;
+		// Only written by the const queries when PBD_HASHING_STATS is on, concurrent queries on the same table then race on it.
+		// Kept whatever PBD_HASHING_STATS is, so the layout of the table doesn't depend on it.
+		mutable QueryStats queries;
 	};
 }
\ No newline at end of file
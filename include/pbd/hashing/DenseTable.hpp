@@ -0,0 +1,319 @@
+#pragma once
+#include <vector>
+
+#include <pbd/hashing/Grid.hpp>
+#include <pbd/common/BBox.hpp>
+#include <pbd/hashing/BaseTable.hpp>
+#include <pbd/hashing/BBoxBatch.hpp>
+#include <pbd/hashing/OverlapList.hpp>
+#include <pbd/hashing/OverlapSink.hpp>
+#include <pbd/hashing/Executor.hpp>
+#include <pbd/hashing/Predicates.hpp>
+#include <pbd/hashing/Trace.hpp>
+
+namespace pbd {
+	// Same interface as the DVTable, for scenes that live in a known bounded box.
+	// The cells covering the domain are stored in a flat array and filled with a counting sort,
+	// so lookups are direct indexing without any hashing.
+	// Cells outside of the domain go to a hashed BaseTable, so objects leaving the domain are still found.
+	// Offset is the type of the positions in the entry list, see BaseTable.
+	template<typename Scalar, typename Index, glm::length_t L, typename GridType = Grid<Index, L, Scalar>, typename Offset = Index>
+	class DenseTable {
+	public:
+		using scalar_t = Scalar;
+		using index_t = Index;
+		using offset_t = Offset;
+		static constexpr glm::length_t Dims = L;
+		using grid_t = GridType;
+		using bbox_t = BBox<Dims, scalar_t>;
+		using vec_t = typename grid_t::vec_t;
+		using ivec_t = typename grid_t::ivec_t;
+		static_assert(std::is_same_v<vec_t, glm::vec<Dims, scalar_t>> && std::is_same_v<ivec_t, glm::vec<Dims, index_t>>, "pbd::DenseTable grid must use the same scalar, index and dimensions as the table!");
+
+		using subtable_t = BaseTable<scalar_t, index_t, Dims, std::hash<ivec_t>, offset_t>;
+		using CellRange = typename subtable_t::CellRange;
+		using entries_t = typename subtable_t::entries_t;
+
+		DenseTable()
+			: lo(0)
+			, dims(0)
+			, strides{}
+			, ndense(0)
+		{}
+
+		// The domain is rounded out to whole cells.
+		void initialize(const grid_t& _grid, const bbox_t& domain) {
+			grid = _grid;
+			lo = grid.calcCell(domain.min);
+			ivec_t hi = grid.calcCell(domain.max);
+			dims = hi - lo + ivec_t(1);
+
+			size_t ncells = 1;
+			for (glm::length_t i = 0; i < Dims; ++i) {
+				assert(dims[i] > 0);
+				strides[i] = ncells;
+				ncells *= static_cast<size_t>(dims[i]);
+			}
+			starts.assign(ncells + 1, 0);
+			clear();
+		}
+		void initialize(const vec_t& _cell_size, const bbox_t& domain) {
+			initialize(grid_t(_cell_size), domain);
+		}
+
+		const grid_t& getGrid() const {
+			return grid;
+		}
+		// Number of cells in the dense part, occupied or not.
+		size_t domainCells() const noexcept {
+			return starts.empty() ? 0 : starts.size() - 1;
+		}
+
+		void clear() {
+			std::fill(starts.begin(), starts.end(), 0);
+			entries.clear();
+			fallback.clear();
+			ndense = 0;
+		}
+
+		// Build from a set of bounding boxes
+		void build(const index_t* const ids, const bbox_t* const bounds, size_t count) {
+			buildBounds(bounds, count, [ids](size_t i) { return ids[i]; });
+		}
+		void build(const bbox_t* const bounds, size_t count) {
+			buildBounds(bounds, count, [](size_t i) { return static_cast<index_t>(i); });
+		}
+
+		// Build from a set of points
+		void build(const index_t* const ids, const vec_t* const points, size_t count) {
+			buildBounds(points, count, [ids](size_t i) { return ids[i]; });
+		}
+		void build(const vec_t* const points, size_t count) {
+			buildBounds(points, count, [](size_t i) { return static_cast<index_t>(i); });
+		}
+
+		// Same as DVTable::findOverlaps, the table must have been built with build(bounds, count).
+		template<typename Predicate = BoxOverlap, detail::enable_if_predicate_t<Predicate, index_t> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapList& list, const Predicate& predicate = {}) const {
+			list.clear();
+
+			detail::OverlapListSink sink{ list };
+			findOverlapsSerial(ids, bounds, count, sink, predicate);
+		}
+		template<typename Predicate = BoxOverlap, detail::enable_if_predicate_t<Predicate, index_t> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, PairList<index_t>& pairs, const Predicate& predicate = {}) const {
+			pairs.clear();
+
+			detail::PairListSink<index_t> sink{ pairs, 0 };
+			findOverlapsSerial(ids, bounds, count, sink, predicate);
+		}
+		template<typename Predicate = BoxOverlap, detail::enable_if_predicate_t<Predicate, index_t> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapCSR<index_t>& csr, const Predicate& predicate = {}) const {
+			auto& pairs = csr.scratch();
+			findOverlaps(ids, bounds, count, pairs, predicate);
+			csr.assign(pairs, detail::vertexCount(ids, count));
+		}
+
+		// Visit the overlapping pairs without storing them, see HTable::forEachOverlap.
+		template<typename Visitor, typename Predicate = BoxOverlap>
+		bool forEachOverlap(const index_t* const ids, const bbox_t* const bounds, size_t count, Visitor&& visitor, const Predicate& predicate = {}) const {
+			detail::VisitorSink<index_t, std::remove_reference_t<Visitor>> sink{ visitor, 0, false };
+			findOverlapsSerial(ids, bounds, count, sink, predicate);
+			return !sink.done();
+		}
+
+		// Same as the above, with the boxes split into parts that run through the executor, see DVTable::findOverlaps.
+		template<typename Executor, typename Predicate = BoxOverlap, detail::enable_if_executor_t<Executor> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapList& list, Executor&& executor, const Predicate& predicate = {}) const {
+			findOverlapsParallel(ids, bounds, count, list, executor, predicate);
+		}
+		template<typename Executor, typename Predicate = BoxOverlap, detail::enable_if_executor_t<Executor> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, PairList<index_t>& pairs, Executor&& executor, const Predicate& predicate = {}) const {
+			findOverlapsParallel(ids, bounds, count, pairs, executor, predicate);
+		}
+		template<typename Executor, typename Predicate = BoxOverlap, detail::enable_if_executor_t<Executor> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapCSR<index_t>& csr, Executor&& executor, const Predicate& predicate = {}) const {
+			auto& pairs = csr.scratch();
+			findOverlapsParallel(ids, bounds, count, pairs, executor, predicate);
+			csr.assign(pairs, detail::vertexCount(ids, count));
+		}
+
+		CellRange find(const vec_t& point) const {
+			return findCell(grid.calcCell(point));
+		}
+		CellRange findCell(const ivec_t& cell) const {
+			size_t index;
+			if (denseIndex(cell, index)) {
+				return CellRange(entries.data() + starts[index], entries.data() + starts[index + 1]);
+			}
+			return fallback.find(cell);
+		}
+
+		// Occupied cells, inside and outside of the domain.
+		size_t numCells() const {
+			return ndense + fallback.numCells();
+		}
+		// Occupied cells outside of the domain.
+		size_t numFallbackCells() const {
+			return fallback.numCells();
+		}
+	private:
+		bool denseIndex(const ivec_t& cell, size_t& index) const noexcept {
+			index = 0;
+			for (glm::length_t i = 0; i < Dims; ++i) {
+				index_t offset = cell[i] - lo[i];
+				if (offset < 0 || offset >= dims[i]) {
+					return false;
+				}
+				index += static_cast<size_t>(offset) * strides[i];
+			}
+			return true;
+		}
+
+		void cellsOf(const bbox_t* const bounds, size_t count) {
+			lows.resize(count);
+			highs.resize(count);
+			grid.calcBounds(bounds, count, lows.data(), highs.data());
+		}
+		void cellsOf(const vec_t* const points, size_t count) {
+			lows.resize(count);
+			grid.calcCells(points, count, lows.data());
+			highs = lows;
+		}
+
+		// Counting sort of the entries into the dense cells, the cells outside go through the hashed table.
+		template<typename Input, typename IdFunc>
+		void buildBounds(const Input* const input, size_t count, IdFunc&& idOf) {
+			assert(!starts.empty() && "pbd::DenseTable must be initialized with a domain before building!");
+			clear();
+			cellsOf(input, count);
+
+			int64_t fallbackEntries = 0;
+			{
+				PBD_HASHING_TRACE_SCOPE("DenseTable::count");
+				for (size_t i = 0; i < count; ++i) {
+					applyAllCells(lows[i], highs[i], [&](const ivec_t& cell) {
+						size_t index;
+						if (denseIndex(cell, index)) {
+							++starts[index];
+						}
+						else {
+							fallback.count(cell, fallbackEntries);
+						}
+					});
+				}
+			}
+
+			{
+				PBD_HASHING_TRACE_SCOPE("DenseTable::prefix");
+				// Running sum, each start holds the end of its cell until the insert pass moves it back.
+				offset_t total = 0;
+				for (size_t c = 0, ncells = domainCells(); c < ncells; ++c) {
+					ndense += starts[c] != 0;
+					total += starts[c];
+					starts[c] = total;
+				}
+				starts[domainCells()] = total;
+				entries.resize(total);
+			}
+			fallback.prepareCellEntries(fallbackEntries);
+
+			PBD_HASHING_TRACE_SCOPE("DenseTable::insert");
+			for (size_t i = 0; i < count; ++i) {
+				index_t id = idOf(i);
+				applyAllCells(lows[i], highs[i], [&](const ivec_t& cell) {
+					size_t index;
+					if (denseIndex(cell, index)) {
+						entries[--starts[index]] = id;
+					}
+					else {
+						fallback.insert(id, cell);
+					}
+				});
+			}
+		}
+
+		template<typename Sink, typename Predicate>
+		void findOverlapsSerial(const index_t* const ids, const bbox_t* const bounds, size_t count, Sink& sink, const Predicate& predicate) const {
+			PBD_HASHING_TRACE_SCOPE("DenseTable::findOverlaps");
+			findOverlapsImpl(ids, bounds, 0, count, sink, predicate);
+		}
+		template<typename Output, typename Executor, typename Predicate>
+		void findOverlapsParallel(const index_t* const ids, const bbox_t* const bounds, size_t count, Output& output, Executor& executor, const Predicate& predicate) const {
+			// A single thread gains nothing from the parts, query straight into the output.
+			if (executor.concurrency() <= 1) {
+				detail::serialQuery(output, [&](auto& sink) {
+					findOverlapsSerial(ids, bounds, count, sink, predicate);
+				});
+				return;
+			}
+
+			PBD_HASHING_TRACE_SCOPE("DenseTable::findOverlaps");
+			// Outputs of the parts are allocated per call, so concurrent queries on the same table share nothing.
+			detail::PartitionedQuery<index_t> partitioned;
+			// The table doesn't keep query counters, the ones of the parts are dropped.
+			partitioned.run(executor, count, output, [&](size_t first, size_t last, auto& sink, QueryStats&) {
+				findOverlapsImpl(ids, bounds, first, last, sink, predicate);
+			});
+		}
+
+		// Queries the boxes [first, last), the pairs are only checked against lower indices so every box has to be in the table.
+		template<typename Sink, typename Predicate>
+		void findOverlapsImpl(const index_t* const ids, const bbox_t* const bounds, size_t first, size_t last, Sink& sink, const Predicate& predicate) const {
+			// Same approach as the DVTable, pairs are only reported from the cell containing the max of the two mins.
+			struct Candidate {
+				index_t cid;
+			};
+			BBoxBatch<Dims, scalar_t, Candidate> batch;
+
+			for (size_t bidx = first; bidx < last && !sink.done(); ++bidx) {
+				const bbox_t& bbox = bounds[bidx];
+
+				auto onOverlap = [&](const Candidate& cand) {
+					if (predicate(static_cast<index_t>(bidx), cand.cid)) {
+						sink.add(ids[cand.cid]);
+					}
+				};
+
+				sink.begin(ids[bidx]);
+
+				ivec_t b0 = grid.calcCell(bbox.min);
+				ivec_t b1 = grid.calcCell(bbox.max);
+				applyAllCells(b0, b1, [&](const ivec_t& loc) {
+					if (sink.done()) {
+						return;
+					}
+					for (index_t cid : findCell(loc)) {
+						// Ignore any ids greater than the box id, to make sure we only add a pairing once.
+						if (cid >= static_cast<index_t>(bidx)) {
+							continue;
+						}
+						// Another shared cell reports the pair, skip it before the box test.
+						if (grid.calcCell(glm::max(bbox.min, bounds[cid].min)) != loc) {
+							continue;
+						}
+						batch.add(bbox, bounds[cid], Candidate{ cid }, onOverlap);
+					}
+				});
+
+				batch.flush(bbox, onOverlap);
+				sink.end();
+			}
+		}
+
+		grid_t grid;
+		// First cell of the domain, and the number of cells along each axis.
+		ivec_t lo, dims;
+		size_t strides[Dims];
+
+		// Start of each dense cell in the entries, with one extra for the end of the last cell.
+		std::vector<offset_t> starts;
+		entries_t entries;
+		size_t ndense;
+
+		subtable_t fallback;
+
+		// Cells of the last build, kept so the memory is reused.
+		std::vector<ivec_t> lows, highs;
+	};
+}
@@ -0,0 +1,279 @@
+#pragma once
+#include <cinttypes>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <exception>
+
+namespace pbd {
+	// Every parallel operation in the library runs through an executor, anything with these two members:
+	//	size_t concurrency() const, the number of ranges worth running at once.
+	//	void parallel_for(size_t begin, size_t end, size_t grain, Func&& func), calls func(first, last) on consecutive
+	//		ranges covering [begin, end), each at least 'grain' long except the last one. Returns when all of them are done.
+	// Wrap an existing job system in a small class like this to share its threads with the tables.
+
+	// Runs everything on the calling thread.
+	class SerialExecutor {
+	public:
+		size_t concurrency() const noexcept {
+			return 1;
+		}
+
+		template<typename Func>
+		void parallel_for(size_t begin, size_t end, size_t, Func&& func) const {
+			if (begin < end) {
+				func(begin, end);
+			}
+		}
+	};
+
+	// Fixed set of std::threads waiting for work, the calling thread takes part in every parallel_for.
+	// Calls from several threads at once are run one after the other, a nested call runs on the calling thread.
+	// When func throws no more chunks are handed out, and the first exception is rethrown on the calling thread
+	// once the chunks already running have finished.
+	class ThreadPool {
+	public:
+		// Total number of threads including the caller, so threads - 1 workers are started.
+		explicit ThreadPool(size_t threads = std::max(1u, std::thread::hardware_concurrency()))
+			: generation(0)
+			, participants(0)
+			, active(0)
+			, stopping(false)
+		{
+			threads = std::max<size_t>(1, threads);
+			workers.reserve(threads - 1);
+			for (size_t i = 1; i < threads; ++i) {
+				workers.emplace_back([this, i]() {
+					work(i - 1);
+				});
+			}
+		}
+		~ThreadPool() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			wake.notify_all();
+			for (std::thread& worker : workers) {
+				worker.join();
+			}
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Pool shared by the functions that take a thread count, sized to the hardware.
+		static ThreadPool& global() {
+			static ThreadPool pool;
+			return pool;
+		}
+
+		size_t concurrency() const noexcept {
+			return workers.size() + 1;
+		}
+
+		template<typename Func>
+		void parallel_for(size_t begin, size_t end, size_t grain, Func&& func) {
+			if (begin >= end) {
+				return;
+			}
+			grain = std::max<size_t>(1, grain);
+			size_t nchunks = (end - begin + grain - 1) / grain;
+			if (nchunks == 1 || workers.empty() || current() == this) {
+				func(begin, end);
+				return;
+			}
+
+			std::lock_guard<std::mutex> submitLock(submit);
+
+			using func_t = std::remove_reference_t<Func>;
+			job.context = const_cast<void*>(static_cast<const void*>(&func));
+			job.invoke = [](void* context, size_t first, size_t last) {
+				(*static_cast<func_t*>(context))(first, last);
+			};
+			job.begin = begin;
+			job.end = end;
+			job.grain = grain;
+			job.nchunks = nchunks;
+			job.next.store(0, std::memory_order_relaxed);
+			job.error = nullptr;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				participants = std::min(workers.size(), nchunks - 1);
+				active = participants;
+				++generation;
+			}
+			wake.notify_all();
+
+			{
+				CurrentGuard guard(this);
+				runChunks();
+			}
+
+			// The job lives on this stack frame, wait until no worker can touch it anymore.
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				done.wait(lock, [this]() {
+					return active == 0;
+				});
+			}
+
+			if (job.error) {
+				std::exception_ptr error = std::move(job.error);
+				job.error = nullptr;
+				std::rethrow_exception(error);
+			}
+		}
+	private:
+		struct Job {
+			void* context = nullptr;
+			void (*invoke)(void*, size_t, size_t) = nullptr;
+			size_t begin = 0, end = 0, grain = 1, nchunks = 0;
+			std::atomic<size_t> next{ 0 };
+
+			// First exception thrown by any chunk, guarded by the pool mutex.
+			std::exception_ptr error;
+		};
+
+		// Marks the calling thread as working for a pool, restored even when a chunk throws.
+		class CurrentGuard {
+		public:
+			explicit CurrentGuard(ThreadPool* pool) noexcept
+				: previous(current())
+			{
+				current() = pool;
+			}
+			~CurrentGuard() {
+				current() = previous;
+			}
+
+			CurrentGuard(const CurrentGuard&) = delete;
+			CurrentGuard& operator=(const CurrentGuard&) = delete;
+		private:
+			ThreadPool* previous;
+		};
+
+		// Pool the calling thread is currently working for, to detect nested calls.
+		static ThreadPool*& current() noexcept {
+			thread_local ThreadPool* pool = nullptr;
+			return pool;
+		}
+
+		// Never throws, the first exception is stored in the job and the remaining chunks are skipped.
+		void runChunks() noexcept {
+			size_t chunk;
+			while ((chunk = job.next.fetch_add(1, std::memory_order_relaxed)) < job.nchunks) {
+				size_t first = job.begin + chunk * job.grain;
+				size_t last = std::min(job.end, first + job.grain);
+				try {
+					job.invoke(job.context, first, last);
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!job.error) {
+						job.error = std::current_exception();
+					}
+					// Push the counter past the end so nobody picks up another chunk.
+					job.next.store(job.nchunks, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		void work(size_t index) {
+			current() = this;
+			uint64_t seen = 0;
+			while (true) {
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					wake.wait(lock, [&]() {
+						return stopping || generation != seen;
+					});
+					if (stopping) {
+						return;
+					}
+					seen = generation;
+					// Small jobs only wake as many workers as there are chunks to share.
+					if (index >= participants) {
+						continue;
+					}
+				}
+
+				runChunks();
+
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--active == 0) {
+					done.notify_one();
+				}
+			}
+		}
+
+		std::vector<std::thread> workers;
+		std::mutex submit;
+
+		std::mutex mutex;
+		std::condition_variable wake, done;
+		uint64_t generation;
+		size_t participants, active;
+		bool stopping;
+
+		Job job;
+	};
+
+	namespace detail {
+		template<typename T, typename = void>
+		struct IsExecutor : std::false_type {};
+		template<typename T>
+		struct IsExecutor<T, std::void_t<decltype(std::declval<const T&>().concurrency())>> : std::true_type {};
+
+		// Used to tell the executor overloads apart from the ones taking a thread count.
+		template<typename T>
+		using enable_if_executor_t = std::enable_if_t<IsExecutor<std::decay_t<T>>::value, int>;
+
+		// Executor for the functions that take a thread count.
+		// Runs on the shared pool, split into 'threads' parts, or inline when threads is 1.
+		class ThreadCountExecutor {
+		public:
+			explicit ThreadCountExecutor(size_t _threads)
+				: threads(std::max<size_t>(1, _threads))
+			{}
+
+			size_t concurrency() const noexcept {
+				return threads;
+			}
+
+			template<typename Func>
+			void parallel_for(size_t begin, size_t end, size_t grain, Func&& func) const {
+				if (threads == 1) {
+					SerialExecutor{}.parallel_for(begin, end, grain, func);
+				}
+				else {
+					ThreadPool::global().parallel_for(begin, end, grain, func);
+				}
+			}
+		private:
+			size_t threads;
+		};
+
+		// Split [0, count) into 'parts' contiguous ranges and run func(first, last, part) on each through the executor.
+		template<typename Executor, typename Func>
+		void parallelRanges(Executor& executor, size_t count, size_t parts, Func&& func) {
+			parts = std::max<size_t>(1, std::min(parts, count));
+			if (parts == 1) {
+				func(size_t(0), count, size_t(0));
+				return;
+			}
+
+			executor.parallel_for(0, parts, 1, [&func, count, parts](size_t first, size_t last) {
+				for (size_t part = first; part < last; ++part) {
+					func((count * part) / parts, (count * (part + 1)) / parts, part);
+				}
+			});
+		}
+	}
+}
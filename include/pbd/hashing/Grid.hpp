@@ -1,11 +1,127 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <type_traits>
+#include <utility>
 #include <glm/glm.hpp>
 #include <glm/common.hpp>
 #include <pbd/hashing/util.hpp>
+#include <pbd/hashing/CellSize.hpp>
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#endif
 
 namespace pbd {
+	namespace detail {
+		// Floor of (x - origin[i % Period]) * scale[i % Period] for a flat array of scalars.
+		// Points and boxes are stored as consecutive scalars, so the pattern repeats with the number of components.
+		template<size_t Period, typename scalar_t, typename index_t>
+		void quantize(const scalar_t* in, const scalar_t* origin, const scalar_t* scale, size_t n, index_t* out) {
+			size_t i = 0;
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+			if constexpr (std::is_same_v<scalar_t, float> && std::is_same_v<index_t, int32_t>) {
+#if defined(__AVX__)
+				constexpr size_t W = 8;
+#else
+				constexpr size_t W = 4;
+#endif
+				// One block is Period registers, after which the scale pattern lines up again.
+				alignas(32) float pattern[Period * W];
+				alignas(32) float offset[Period * W];
+				for (size_t k = 0; k < Period * W; ++k) {
+					pattern[k] = scale[k % Period];
+					offset[k] = origin[k % Period];
+				}
+
+				for (; i + Period * W <= n; i += Period * W) {
+					for (size_t r = 0; r < Period; ++r) {
+#if defined(__AVX__)
+						__m256 v = _mm256_sub_ps(_mm256_loadu_ps(in + i + r * W), _mm256_load_ps(offset + r * W));
+						v = _mm256_mul_ps(v, _mm256_load_ps(pattern + r * W));
+						__m256i c = _mm256_cvtps_epi32(_mm256_floor_ps(v));
+						_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + r * W), c);
+#else
+						// No floor instruction in SSE2, truncate then step down where the truncation rounded up.
+						__m128 v = _mm_sub_ps(_mm_loadu_ps(in + i + r * W), _mm_load_ps(offset + r * W));
+						v = _mm_mul_ps(v, _mm_load_ps(pattern + r * W));
+						__m128i c = _mm_cvttps_epi32(v);
+						__m128 up = _mm_cmpgt_ps(_mm_cvtepi32_ps(c), v);
+						c = _mm_add_epi32(c, _mm_castps_si128(up));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + r * W), c);
+#endif
+					}
+				}
+			}
+#endif
+			for (; i < n; ++i) {
+				out[i] = static_cast<index_t>(std::floor((in[i] - origin[i % Period]) * scale[i % Period]));
+			}
+		}
+
+		// True when the vectors are tightly packed scalars, so arrays of them can be quantized as flat arrays.
+		template<glm::length_t L, typename scalar_t, typename index_t>
+		inline constexpr bool packedVectors = sizeof(glm::vec<L, scalar_t>) == L * sizeof(scalar_t)
+			&& sizeof(glm::vec<L, index_t>) == L * sizeof(index_t)
+			&& sizeof(BBox<L, scalar_t>) == 2 * sizeof(glm::vec<L, scalar_t>);
+
+		template<glm::length_t L, typename scalar_t, typename index_t>
+		void calcCells(const glm::vec<L, scalar_t>& origin, const glm::vec<L, scalar_t>& scale, const glm::vec<L, scalar_t>* const points, size_t count, glm::vec<L, index_t>* const cells) {
+			if (count == 0) {
+				return;
+			}
+			if constexpr (packedVectors<L, scalar_t, index_t>) {
+				scalar_t pattern[L], offset[L];
+				for (glm::length_t i = 0; i < L; ++i) {
+					pattern[i] = scale[i];
+					offset[i] = origin[i];
+				}
+				quantize<L>(&points[0][0], offset, pattern, count * L, &cells[0][0]);
+			}
+			else {
+				for (size_t k = 0; k < count; ++k) {
+					for (glm::length_t i = 0; i < L; ++i) {
+						cells[k][i] = static_cast<index_t>(std::floor((points[k][i] - origin[i]) * scale[i]));
+					}
+				}
+			}
+		}
+
+		template<glm::length_t L, typename scalar_t, typename index_t>
+		void calcBounds(const glm::vec<L, scalar_t>& origin, const glm::vec<L, scalar_t>& scale, const BBox<L, scalar_t>* const bounds, size_t count, glm::vec<L, index_t>* const b0, glm::vec<L, index_t>* const b1) {
+			using ivec_t = glm::vec<L, index_t>;
+			if constexpr (packedVectors<L, scalar_t, index_t>) {
+				// Quantize both corners together in chunks, then split them into the two outputs.
+				constexpr size_t Chunk = 64;
+				scalar_t pattern[2 * L], offset[2 * L];
+				for (glm::length_t i = 0; i < L; ++i) {
+					pattern[i] = scale[i];
+					pattern[i + L] = scale[i];
+					offset[i] = origin[i];
+					offset[i + L] = origin[i];
+				}
+				ivec_t corners[2 * Chunk];
+				for (size_t first = 0; first < count; first += Chunk) {
+					size_t n = std::min(Chunk, count - first);
+					quantize<2 * L>(&bounds[first].min[0], offset, pattern, n * 2 * L, &corners[0][0]);
+					for (size_t k = 0; k < n; ++k) {
+						b0[first + k] = corners[2 * k];
+						b1[first + k] = corners[2 * k + 1];
+					}
+				}
+			}
+			else {
+				for (size_t k = 0; k < count; ++k) {
+					for (glm::length_t i = 0; i < L; ++i) {
+						b0[k][i] = static_cast<index_t>(std::floor((bounds[k].min[i] - origin[i]) * scale[i]));
+						b1[k][i] = static_cast<index_t>(std::floor((bounds[k].max[i] - origin[i]) * scale[i]));
+					}
+				}
+			}
+		}
+	}
+
 	template<typename index_t, glm::length_t L, typename scalar_t>
 	class Grid {
 	public:
@@ -15,22 +131,40 @@ namespace pbd {
 		Grid()
 			: mscale(1)
 			, mcell(1)
+			, morigin(0)
 		{}
-		Grid(const vec_t& _cell_size)
+		Grid(const vec_t& _cell_size, const vec_t& _origin = vec_t(0))
 			: mcell(_cell_size)
+			, morigin(_origin)
 		{
 			assert(glm::all(glm::greaterThan(mcell, vec_t(scalar_t(1e-5)))));
 			mscale = vec_t(1) / mcell;
 		}
 
+		// Grid with the cell size that minimizes the expected entries and candidate tests for the bounds, see chooseCellSize.
+		static Grid fromBounds(const BBox<L, scalar_t>* const bounds, size_t count, const CellSizePolicy<scalar_t>& policy = {}) {
+			return Grid(chooseCellSize(bounds, count, 1, policy).cell);
+		}
+
+		// Cell i covers [i, i+1) cell widths from the origin on each axis, negative coordinates round down as well.
+		// Coordinates are made relative to the origin before scaling, so the cell indices stay small
+		// and the quantization keeps its precision when the scene is far from the world origin.
 		ivec_t calcCell(const vec_t& vec) const {
-			vec_t offset = vec * mscale;
+			vec_t offset = (vec - morigin) * mscale;
 			ivec_t ioffset;
 			for (glm::length_t i = 0; i < L; ++i) {
-				ioffset[i] = static_cast<index_t>(offset[i]);
+				ioffset[i] = static_cast<index_t>(std::floor(offset[i]));
 			}
 			return ioffset;
 		}
+		// Same as calcCell for an array of points, vectorized when the instruction set allows it.
+		void calcCells(const vec_t* const points, size_t count, ivec_t* const cells) const {
+			detail::calcCells(morigin, mscale, points, count, cells);
+		}
+		// Cells of the min and max corners of each box.
+		void calcBounds(const BBox<L, scalar_t>* const bounds, size_t count, ivec_t* const b0, ivec_t* const b1) const {
+			detail::calcBounds(morigin, mscale, bounds, count, b0, b1);
+		}
 
 		const vec_t& cell() const noexcept {
 			return mcell;
@@ -38,10 +172,47 @@ namespace pbd {
 		const vec_t& scale() const noexcept {
 			return mscale;
 		}
+		const vec_t& origin() const noexcept {
+			return morigin;
+		}
+
+		// Move the origin to the cell corner nearest to the anchor, on a lattice of 'stride' cells.
+		// Cells of the new origin line up with the old ones, shifted by the returned number of cells.
+		// Tables keyed by this grid have to be rebuilt afterwards.
+		ivec_t rebase(const vec_t& anchor, index_t stride = 1) {
+			assert(stride > 0);
+			vec_t step = mcell * static_cast<scalar_t>(stride);
+			ivec_t shift;
+			for (glm::length_t i = 0; i < L; ++i) {
+				shift[i] = static_cast<index_t>(std::floor((anchor[i] - morigin[i]) / step[i] + scalar_t(0.5))) * stride;
+				morigin[i] += static_cast<scalar_t>(shift[i]) * mcell[i];
+			}
+			return shift;
+		}
+		// Rebase only once the anchor drifted further than 'distance' from the origin on any axis.
+		// Returns true when the origin moved.
+		bool rebaseIfFar(const vec_t& anchor, scalar_t distance, index_t stride = 1) {
+			for (glm::length_t i = 0; i < L; ++i) {
+				if (std::abs(anchor[i] - morigin[i]) > distance) {
+					rebase(anchor, stride);
+					return true;
+				}
+			}
+			return false;
+		}
 	private:
-		vec_t mscale, mcell;
+		vec_t mscale, mcell, morigin;
 	};
 
+	namespace detail {
+		// True for the grid policies with a movable origin, only Grid has one.
+		template<typename T, typename = void>
+		struct HasOrigin : std::false_type {};
+		template<typename T>
+		struct HasOrigin<T, std::void_t<decltype(std::declval<T&>().rebase(std::declval<const typename T::vec_t&>()))>> : std::true_type {};
+	}
+
+	// Same cell size on every axis and no origin, see Grid for the details.
 	template<typename index_t, glm::length_t L, typename scalar_t>
 	class UniformGrid {
 	public:
@@ -49,26 +220,39 @@ namespace pbd {
 		using ivec_t = glm::vec<L, index_t>;
 
 		UniformGrid()
-			: mcell(1)
-			, mscale(1)
+			: mscale(1)
+			, mcell(1)
 		{}
 		UniformGrid(scalar_t _cell_size)
 			: mcell(_cell_size)
 		{
+			assert(mcell > scalar_t(1e-5));
 			mscale = scalar_t(1) / mcell;
 		}
 
+		// Same as Grid::fromBounds, with a single size for every axis.
+		static UniformGrid fromBounds(const BBox<L, scalar_t>* const bounds, size_t count, CellSizePolicy<scalar_t> policy = {}) {
+			policy.uniform = true;
+			return UniformGrid(chooseCellSize(bounds, count, 1, policy).cell[0]);
+		}
+
 		ivec_t calcCell(const vec_t& vec) const {
 			vec_t offset = vec * vec_t(mscale);
 			ivec_t ioffset;
 			for (glm::length_t i = 0; i < L; ++i) {
-				ioffset[i] = static_cast<index_t>(offset[i]);
+				ioffset[i] = static_cast<index_t>(std::floor(offset[i]));
 			}
 			return ioffset;
 		}
+		void calcCells(const vec_t* const points, size_t count, ivec_t* const cells) const {
+			detail::calcCells(vec_t(0), vec_t(mscale), points, count, cells);
+		}
+		void calcBounds(const BBox<L, scalar_t>* const bounds, size_t count, ivec_t* const b0, ivec_t* const b1) const {
+			detail::calcBounds(vec_t(0), vec_t(mscale), bounds, count, b0, b1);
+		}
 
 		const scalar_t& cell() const noexcept {
-			return mcells;
+			return mcell;
 		}
 		const scalar_t& scale() const noexcept {
 			return mscale;
@@ -76,4 +260,54 @@ namespace pbd {
 	private:
 		scalar_t mscale, mcell;
 	};
+
+	namespace detail {
+		template<typename scalar_t>
+		constexpr scalar_t exp2(int exponent) noexcept {
+			scalar_t result = scalar_t(1);
+			for (; exponent > 0; --exponent) {
+				result *= scalar_t(2);
+			}
+			for (; exponent < 0; ++exponent) {
+				result /= scalar_t(2);
+			}
+			return result;
+		}
+	}
+
+	// Cells of 2^Exponent on every axis, fixed at compile time.
+	// Quantizing is the same multiply and floor as the other grids, with a constant scale and no origin.
+	// The scale is a power of two, so the multiply is exact and cells line up with the binary representation of the coordinates.
+	// Tier t of an HTable using this grid has the same cells as Pow2Grid<..., Exponent + t>.
+	template<typename index_t, glm::length_t L, typename scalar_t, int Exponent>
+	class Pow2Grid {
+	public:
+		using vec_t = glm::vec<L, scalar_t>;
+		using ivec_t = glm::vec<L, index_t>;
+
+		static constexpr int exponent = Exponent;
+		static constexpr scalar_t cellSize = detail::exp2<scalar_t>(Exponent);
+		static constexpr scalar_t scaleFactor = detail::exp2<scalar_t>(-Exponent);
+
+		ivec_t calcCell(const vec_t& vec) const {
+			ivec_t ioffset;
+			for (glm::length_t i = 0; i < L; ++i) {
+				ioffset[i] = static_cast<index_t>(std::floor(vec[i] * scaleFactor));
+			}
+			return ioffset;
+		}
+		void calcCells(const vec_t* const points, size_t count, ivec_t* const cells) const {
+			detail::calcCells(vec_t(0), vec_t(scaleFactor), points, count, cells);
+		}
+		void calcBounds(const BBox<L, scalar_t>* const bounds, size_t count, ivec_t* const b0, ivec_t* const b1) const {
+			detail::calcBounds(vec_t(0), vec_t(scaleFactor), bounds, count, b0, b1);
+		}
+
+		scalar_t cell() const noexcept {
+			return cellSize;
+		}
+		scalar_t scale() const noexcept {
+			return scaleFactor;
+		}
+	};
 }
\ No newline at end of file
@@ -1,28 +1,40 @@
 #pragma once
 #include <cinttypes>
 #include <vector>
+#include <array>
 
 #include <pbd/hashing/util.hpp>
 #include <parallel_hashmap/phmap.h>
 
 #include <pbd/hashing/Grid.hpp>
 #include <pbd/common/BBox.hpp>
+#include <pbd/hashing/BBoxBatch.hpp>
 #include <pbd/hashing/OverlapList.hpp>
+#include <pbd/hashing/OverlapSink.hpp>
+#include <pbd/hashing/Executor.hpp>
+#include <pbd/hashing/Predicates.hpp>
+#include <pbd/hashing/Stats.hpp>
+#include <pbd/hashing/Trace.hpp>
 
 namespace pbd {
 	// Heirarchical hash table, multiple size tiers for objects to be inserted.
 	// Uses the smallest tier that an object will fit into to minimize the number of entries that are created.
-	template<typename Scalar, typename Index, glm::length_t L, size_t MaxTiers = 64>
+	// The grid of the first tier is a policy, any of Grid, UniformGrid or Pow2Grid can be used.
+	// Offset is the type of the positions in the entry list, see BaseTable.
+	template<typename Scalar, typename Index, glm::length_t L, size_t MaxTiers = 64, typename GridType = Grid<Index, L, Scalar>, typename Offset = Index>
 	class HTable {
 	public:
 		using scalar_t = Scalar;
 		using index_t = Index;
+		using offset_t = Offset;
 		static constexpr glm::length_t Dims = L;
-		using grid_t = Grid<index_t, Dims, scalar_t>;
+		using grid_t = GridType;
 		using bbox_t = BBox<Dims, scalar_t>;
 		using vec_t = typename grid_t::vec_t;
 		using ivec_t = typename grid_t::ivec_t;
+		static_assert(std::is_same_v<vec_t, glm::vec<Dims, scalar_t>> && std::is_same_v<ivec_t, glm::vec<Dims, index_t>>, "pbd::HTable grid must use the same scalar, index and dimensions as the table!");
 		static constexpr size_t max_tiers = MaxTiers;
+		using spheres_t = SphereOverlap<Dims, scalar_t>;
 	
 		struct Cell {
 			index_t tier;
@@ -44,15 +56,20 @@ namespace pbd {
 			}
 		};
 
-		using map_t = phmap::parallel_flat_hash_map<Cell, index_t>;
+		using map_t = phmap::parallel_flat_hash_map<Cell, offset_t>;
 		using map_iter_t = typename map_t::const_iterator;
 		using entries_t = std::vector<index_t>;
 
 		static constexpr ptrdiff_t MaxIndex = std::numeric_limits<index_t>::max();
 		static constexpr ptrdiff_t MinIndex = std::numeric_limits<index_t>::lowest();
+		static constexpr uint64_t MaxOffset = static_cast<uint64_t>(std::numeric_limits<offset_t>::max());
 
 		class CellRange;
 		class const_iterator;
+
+		// Cells of a tier are split into 2^Dims batches by the parity of their coordinates.
+		static constexpr size_t NumParities = size_t(1) << Dims;
+		using parity_batches_t = std::array<std::vector<const_iterator>, NumParities>;
 	private:
 		// Linear search
 		static index_t msb1(index_t val) {
@@ -89,15 +106,28 @@ namespace pbd {
 		{
 			initialize(_cell_size, ntiers);
 		}
+		HTable(const grid_t& _grid, size_t ntiers)
+		{
+			initialize(_grid, ntiers);
+		}
 
 		void initialize(const vec_t & _cell_size, size_t ntiers) {
 			initialize(grid_t(_cell_size), ntiers);
 		}
+		// Pick the cell size and the number of tiers from the bounds, see chooseCellSize.
+		void initialize(const bbox_t* const bounds, size_t count, const CellSizePolicy<scalar_t>& policy = {}) {
+			// Tiers are coarsened with shifts of index_t.
+			size_t limit = std::min(maxTiers() - 1, sizeof(index_t) * 8 - 2);
+			CellSizeChoice<Dims, scalar_t> choice = chooseCellSize(bounds, count, limit, policy);
+			initialize(grid_t(choice.cell), choice.tiers);
+		}
 		void initialize(const grid_t& _grid, size_t ntiers) {
 			grid = _grid;
 
 			assert(ntiers < maxTiers());
-			ntiers = std::min(maxTiers(), ntiers);
+			// Tiers are coarsened with shifts of index_t, and rebase snaps the origin to 1 << (ntiers - 1) cells.
+			assert(ntiers < sizeof(index_t) * 8);
+			ntiers = std::min({ maxTiers(), sizeof(index_t) * 8 - 1, ntiers });
 
 			tier_limit = ntiers;
 
@@ -123,6 +153,15 @@ namespace pbd {
 		const grid_t& getGrid() const {
 			return grid;
 		}
+		// Move the grid origin next to the anchor, see Grid::rebase. Only the Grid policy has an origin.
+		// The origin snaps to the cells of the top tier, so the tiers stay nested. The table has to be rebuilt.
+		void rebase(const vec_t& anchor) {
+			static_assert(detail::HasOrigin<grid_t>::value, "pbd::HTable::rebase needs a grid policy with an origin, use Grid!");
+			assert(isInitialized() && tier_limit < sizeof(index_t) * 8);
+			grid.rebase(anchor, index_t(1) << (tier_limit - 1));
+			cell_map.clear();
+			cell_entries.clear();
+		}
 		size_t numTiers() const {
 			return tier_limit;
 		}
@@ -133,53 +172,273 @@ namespace pbd {
 			return cell_map.size();
 		}
 
+		// Group the occupied cells into checkerboard batches, one set of batches per tier, see pbd::parityOf.
+		// Two different cells in the same batch of a tier never touch, so the cells of a batch can be processed in parallel.
+		// An object spanning several cells of its tier shows up in several cells of the same batch though,
+		// so a parallel pass over a batch must not write per object state without synchronization.
+		// Cells of different tiers overlap each other, so the tiers have to be processed one after another.
+		void parityBatches(std::vector<parity_batches_t>& tiers) const {
+			tiers.resize(tier_limit);
+			for (auto& batches : tiers) {
+				for (auto& batch : batches) {
+					batch.clear();
+				}
+			}
+			for (const_iterator it = begin(), last = end(); it != last; ++it) {
+				const Cell& cell = it.cell();
+				tiers[cell.tier][parityOf(cell.index)].push_back(it);
+			}
+		}
+
+		// Layout of the table after build, including the per tier counts, along with the counters of the last findOverlaps call.
+		// Walks every cell, so it costs about as much as iterating the table.
+		TableStats stats() const {
+			static_assert(MaxTiers <= 64, "pbd::HTable::stats tracks the tiers of an object in a 64 bit mask!");
+
+			TableStats result;
+			result.tiers.resize(tier_limit);
+
+			// Objects span several cells, mark the tiers each id was seen in so they are only counted once.
+			std::vector<uint64_t> seen;
+			for (const_iterator it = begin(), last = end(); it != last; ++it) {
+				CellRange range = it.range();
+				TierStats& tier = result.tiers[it.cell().tier];
+				++tier.cells;
+				tier.entries += range.size();
+				result.addCell(range.size());
+
+				for (index_t id : range) {
+					if (seen.size() <= static_cast<size_t>(id)) {
+						seen.resize(static_cast<size_t>(id) + 1, 0);
+					}
+					seen[id] |= uint64_t(1) << it.cell().tier;
+				}
+			}
+			for (uint64_t tiers : seen) {
+				for (size_t tier = 0; tiers != 0; ++tier, tiers >>= 1) {
+					result.tiers[tier].objects += tiers & 1;
+				}
+			}
+			result.finish();
+
+			result.loadFactor = cell_map.load_factor();
+			// Flat maps store one control byte per slot next to the value.
+			result.bytes = cell_map.capacity() * (sizeof(typename map_t::value_type) + 1) + cell_entries.capacity() * sizeof(index_t);
+			result.queries = queries;
+			return result;
+		}
+
+		const_iterator begin() const noexcept {
+			return const_iterator(cell_map.begin(), cell_entries);
+		}
+		const_iterator end() const noexcept {
+			return const_iterator(cell_map.end(), cell_entries);
+		}
+
 		void build(const bbox_t* const bounds, size_t count) {
 			if (tier_limit == 0) {
 				return;
 			}
 
-			// Iterate over all the bounds
-			// Classify the tier each one fits best.
-			// Insert into said tier.
+			// Classify the tier each bound fits best.
+			// Count the entries of every cell, then insert into said tier.
 			
 			// This may not perform well when one of the bound dimensions is much smaller than the others.
 
-			size_t element_count = 0;
-			cell_map.clear();
-			cell_entries.clear();
-
-			ClassifiedTier ctier;
+			{
+				PBD_HASHING_TRACE_SCOPE("HTable::classify");
+				lows.resize(count);
+				highs.resize(count);
+				grid.calcBounds(bounds, count, lows.data(), highs.data());
+				classifyAll(count);
+			}
+			buildClassified(count);
+		}
+		// Build from spheres instead of boxes, for particles.
+		// The boxes are made a chunk at a time while classifying, so no bounds array has to be filled and read back.
+		void build(const vec_t* const centers, const scalar_t* const radii, size_t count) {
+			build(spheres_t{ centers, radii }, count);
+		}
+		// Same as above, with the same radius for every sphere.
+		// The radius comes first, so a literal 0 can't be mistaken for a null radii array.
+		void build(scalar_t radius, const vec_t* const centers, size_t count) {
+			build(spheres_t{ centers, nullptr, radius }, count);
+		}
+		void build(const spheres_t& spheres, size_t count) {
+			if (tier_limit == 0) {
+				return;
+			}
 
-			const bbox_t* boxit = bounds;
-			const bbox_t* boxend = bounds + count;
-			for (; boxit != boxend; ++boxit) {
-				ctier = classify(*boxit);
-				applyAllCells(ctier.b0, ctier.b1, [&](const ivec_t & vec){
-					auto it = cell_map.find(Cell{ctier.msb, vec});
-					if (it == cell_map.end()) {
-						// We start at 2, to reserve a place for the entry count.
-						// We put it in the entry list so the elements in the cell map are as small as possible.
-						cell_map.insert(it, { Cell{ctier.msb, vec}, 2});
-						element_count += 2;
-					}
-					else {
-						++element_count;
-						++it->second;
+			{
+				PBD_HASHING_TRACE_SCOPE("HTable::classify");
+				lows.resize(count);
+				highs.resize(count);
+
+				// Small enough to stay on the stack, large enough for the vectorized cell computation.
+				std::array<bbox_t, 64> chunk;
+				for (size_t first = 0; first < count; first += chunk.size()) {
+					size_t n = std::min(chunk.size(), count - first);
+					for (size_t i = 0; i < n; ++i) {
+						chunk[i] = spheres.bounds(first + i);
 					}
-				});
+					grid.calcBounds(chunk.data(), n, lows.data() + first, highs.data() + first);
+				}
+				classifyAll(count);
 			}
+			buildClassified(count);
+		}
 
-			prepareCellEntries(element_count);
+		// Find all the overlapping pairs among the bounds the table was built from.
+		// Each group in the list starts with the id of a box, followed by the ids of the boxes it overlaps.
+		// The predicate is an optional narrow phase test, run once on every pair whose boxes overlap. See Predicates.hpp.
+		template<typename Predicate = BoxOverlap, detail::enable_if_predicate_t<Predicate, index_t> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapList& list, const Predicate& predicate = {}) {
+			list.clear();
+
+			detail::OverlapListSink sink{ list };
+			findOverlapsSerial(ids, BoundsArray{ bounds }, count, sink, predicate);
+		}
+		// Same as above, but writes each pair directly into a flat list.
+		// The list is cleared first, its capacity is kept so it can be reused from frame to frame.
+		template<typename Predicate = BoxOverlap, detail::enable_if_predicate_t<Predicate, index_t> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, PairList<index_t>& pairs, const Predicate& predicate = {}) {
+			pairs.clear();
+
+			detail::PairListSink<index_t> sink{ pairs, 0 };
+			findOverlapsSerial(ids, BoundsArray{ bounds }, count, sink, predicate);
+		}
+		// Same as above, but writes a symmetric adjacency indexed by the ids.
+		template<typename Predicate = BoxOverlap, detail::enable_if_predicate_t<Predicate, index_t> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapCSR<index_t>& csr, const Predicate& predicate = {}) {
+			auto& pairs = csr.scratch();
+			findOverlaps(ids, bounds, count, pairs, predicate);
+			csr.assign(pairs, detail::vertexCount(ids, count));
+		}
 
-			boxit = bounds;
-			for (size_t i = 0; i < count; ++i, ++boxit) {
-				ctier = classify(*boxit);
+		// Call visitor(id, other) for every overlapping pair, without storing the pairs anywhere.
+		// 'id' is the box being queried and 'other' a box it overlaps, same order as the pairs of findOverlaps.
+		// The visitor may return bool, returning false stops the query. Returns false if the query was stopped.
+		template<typename Visitor, typename Predicate = BoxOverlap>
+		bool forEachOverlap(const index_t* const ids, const bbox_t* const bounds, size_t count, Visitor&& visitor, const Predicate& predicate = {}) {
+			detail::VisitorSink<index_t, std::remove_reference_t<Visitor>> sink{ visitor, 0, false };
+			findOverlapsSerial(ids, BoundsArray{ bounds }, count, sink, predicate);
+			return !sink.done();
+		}
 
-				insert(static_cast<index_t>(i), ctier.msb, ctier.b0, ctier.b1);
+		// Same as the above, with the boxes split into parts that run through the executor, see Executor.hpp.
+		// The output is the same as the serial version. The table itself is only read.
+		template<typename Executor, typename Predicate = BoxOverlap, detail::enable_if_executor_t<Executor> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapList& list, Executor&& executor, const Predicate& predicate = {}) {
+			findOverlapsParallel(ids, BoundsArray{ bounds }, count, list, executor, predicate);
+		}
+		template<typename Executor, typename Predicate = BoxOverlap, detail::enable_if_executor_t<Executor> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, PairList<index_t>& pairs, Executor&& executor, const Predicate& predicate = {}) {
+			findOverlapsParallel(ids, BoundsArray{ bounds }, count, pairs, executor, predicate);
+		}
+		template<typename Executor, typename Predicate = BoxOverlap, detail::enable_if_executor_t<Executor> = 0>
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapCSR<index_t>& csr, Executor&& executor, const Predicate& predicate = {}) {
+			auto& pairs = csr.scratch();
+			findOverlapsParallel(ids, BoundsArray{ bounds }, count, pairs, executor, predicate);
+			csr.assign(pairs, detail::vertexCount(ids, count));
+		}
+
+		// Find all the overlapping pairs among the spheres the table was built from, see build(spheres, count).
+		// The pairs are tested sphere against sphere, boxes that only touch in the corners are dropped.
+		// The predicate is an optional extra narrow phase test, run on the pairs whose spheres overlap.
+		// Same outputs and executor overloads as the box queries.
+		template<typename Predicate = BoxOverlap, detail::enable_if_predicate_t<Predicate, index_t> = 0>
+		void findOverlaps(const index_t* const ids, const spheres_t& spheres, size_t count, OverlapList& list, const Predicate& predicate = {}) {
+			list.clear();
+
+			detail::OverlapListSink sink{ list };
+			findOverlapsSerial(ids, SphereBounds{ spheres }, count, sink, spherePredicate(spheres, predicate));
+		}
+		template<typename Predicate = BoxOverlap, detail::enable_if_predicate_t<Predicate, index_t> = 0>
+		void findOverlaps(const index_t* const ids, const spheres_t& spheres, size_t count, PairList<index_t>& pairs, const Predicate& predicate = {}) {
+			pairs.clear();
+
+			detail::PairListSink<index_t> sink{ pairs, 0 };
+			findOverlapsSerial(ids, SphereBounds{ spheres }, count, sink, spherePredicate(spheres, predicate));
+		}
+		template<typename Predicate = BoxOverlap, detail::enable_if_predicate_t<Predicate, index_t> = 0>
+		void findOverlaps(const index_t* const ids, const spheres_t& spheres, size_t count, OverlapCSR<index_t>& csr, const Predicate& predicate = {}) {
+			auto& pairs = csr.scratch();
+			findOverlaps(ids, spheres, count, pairs, predicate);
+			csr.assign(pairs, detail::vertexCount(ids, count));
+		}
+		template<typename Visitor, typename Predicate = BoxOverlap>
+		bool forEachOverlap(const index_t* const ids, const spheres_t& spheres, size_t count, Visitor&& visitor, const Predicate& predicate = {}) {
+			detail::VisitorSink<index_t, std::remove_reference_t<Visitor>> sink{ visitor, 0, false };
+			findOverlapsSerial(ids, SphereBounds{ spheres }, count, sink, spherePredicate(spheres, predicate));
+			return !sink.done();
+		}
+
+		template<typename Executor, typename Predicate = BoxOverlap, detail::enable_if_executor_t<Executor> = 0>
+		void findOverlaps(const index_t* const ids, const spheres_t& spheres, size_t count, OverlapList& list, Executor&& executor, const Predicate& predicate = {}) {
+			findOverlapsParallel(ids, SphereBounds{ spheres }, count, list, executor, spherePredicate(spheres, predicate));
+		}
+		template<typename Executor, typename Predicate = BoxOverlap, detail::enable_if_executor_t<Executor> = 0>
+		void findOverlaps(const index_t* const ids, const spheres_t& spheres, size_t count, PairList<index_t>& pairs, Executor&& executor, const Predicate& predicate = {}) {
+			findOverlapsParallel(ids, SphereBounds{ spheres }, count, pairs, executor, spherePredicate(spheres, predicate));
+		}
+		template<typename Executor, typename Predicate = BoxOverlap, detail::enable_if_executor_t<Executor> = 0>
+		void findOverlaps(const index_t* const ids, const spheres_t& spheres, size_t count, OverlapCSR<index_t>& csr, Executor&& executor, const Predicate& predicate = {}) {
+			auto& pairs = csr.scratch();
+			findOverlapsParallel(ids, SphereBounds{ spheres }, count, pairs, executor, spherePredicate(spheres, predicate));
+			csr.assign(pairs, detail::vertexCount(ids, count));
+		}
+
+	private:
+		// Where the queries read the box of an object from, the bounds array or the spheres.
+		struct BoundsArray {
+			const bbox_t* bounds;
+
+			const bbox_t& operator()(size_t i) const noexcept {
+				return bounds[i];
+			}
+		};
+		struct SphereBounds {
+			const spheres_t& spheres;
+
+			bbox_t operator()(size_t i) const noexcept {
+				return spheres.bounds(i);
 			}
+		};
+
+		// The sphere test first, then the one passed by the user.
+		template<typename Predicate>
+		static detail::BothOverlap<spheres_t, Predicate> spherePredicate(const spheres_t& spheres, const Predicate& predicate) noexcept {
+			return { spheres, predicate };
 		}
 
-		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapList& list) {
+		template<typename Bounds, typename Sink, typename Predicate>
+		void findOverlapsSerial(const index_t* const ids, const Bounds& boundsOf, size_t count, Sink& sink, const Predicate& predicate) {
+			PBD_HASHING_TRACE_SCOPE("HTable::findOverlaps");
+			QueryStats counters;
+			findOverlapsImpl(ids, boundsOf, 0, count, sink, predicate, counters);
+			PBD_HASHING_STAT(queries = counters);
+		}
+		template<typename Bounds, typename Output, typename Executor, typename Predicate>
+		void findOverlapsParallel(const index_t* const ids, const Bounds& boundsOf, size_t count, Output& output, Executor& executor, const Predicate& predicate) {
+			// A single thread gains nothing from the parts, query straight into the output.
+			if (executor.concurrency() <= 1) {
+				detail::serialQuery(output, [&](auto& sink) {
+					findOverlapsSerial(ids, boundsOf, count, sink, predicate);
+				});
+				return;
+			}
+
+			PBD_HASHING_TRACE_SCOPE("HTable::findOverlaps");
+			QueryStats counters = partitioned.run(executor, count, output, [&](size_t first, size_t last, auto& sink, QueryStats& partCounters) {
+				findOverlapsImpl(ids, boundsOf, first, last, sink, predicate, partCounters);
+			});
+			PBD_HASHING_STAT(queries = counters);
+		}
+
+		// Queries the boxes [first, last), every box has to be in the table.
+		template<typename Bounds, typename Sink, typename Predicate>
+		void findOverlapsImpl(const index_t* const ids, const Bounds& boundsOf, size_t first, size_t last, Sink& sink, const Predicate& predicate, QueryStats& result) const {
+
 			/*
 			Iterate over all the bounding boxes. Classify the box tier.
 			For each cell it it occupies in its tier, check for overlap with the other bboxes in the cell.
@@ -188,73 +447,79 @@ namespace pbd {
 
 			Then we check all the bboxes in the tiers above it. 
 			Note that we don't need to skip any pairings this time, because we don't compare downward.
+
+			A pair of boxes sharing more than one cell would be found once per shared cell.
+			Only the cell containing the max of the two mins (the reference point) reports the pair,
+			so every pair is added exactly once and the sink doesn't have to deduplicate anything.
+			The check only needs the two mins, so it runs before the box test and the other cells never test the pair.
 			*/
 
-			list.clear();
+			struct Candidate {
+				index_t cid;
+			};
+			// Candidates are gathered into a batch and tested against the box several at a time.
+			BBoxBatch<Dims, scalar_t, Candidate> batch;
+			PBD_HASHING_STAT(QueryStats counters);
 
 			// Iterate the bounds
-			const bbox_t * boxit = bounds;
-			const bbox_t* const boxend = bounds + count;
-			size_t bidx = 0;
 			ClassifiedTier ctier;
-			for (; boxit != boxend; ++boxit, ++bidx) {
-				const bbox_t& bbox = *boxit;
-				ctier = classify(*boxit);
+			for (size_t bidx = first; bidx != last && !sink.done(); ++bidx) {
+				// A reference into the bounds array, or a box made from a sphere.
+				decltype(auto) bbox = boundsOf(bidx);
+				ctier = classify(bbox);
+
+				// Only candidates in their reference cell reach the batch, so the narrow phase test runs once per pair.
+				auto onOverlap = [&](const Candidate& cand) {
+					if (predicate(static_cast<index_t>(bidx), cand.cid)) {
+						sink.add(ids[cand.cid]);
+						PBD_HASHING_STAT(++counters.accepted);
+					}
+					else {
+						PBD_HASHING_STAT(++counters.rejected);
+					}
+				};
 
-				list.group();
-				list.push(ids[bidx]);
+				sink.begin(ids[bidx]);
 
-				// For the first tier the bound is in:
-				{
+				for (index_t tier = ctier.msb, ntiers = tier_limit; tier < ntiers; ++tier) {
 					// For each cell the bound occupies, find it in the table
 					applyAllCells(ctier.b0, ctier.b1, [&](const ivec_t& loc) {
+						if (sink.done()) {
+							return;
+						}
 						// Find the cell 'loc' in the table.
-						CellRange cell = find(ctier.msb, loc);
+						CellRange cell = find(tier, loc);
 
 						// For each element in the range, check if it overlaps.
 						for (index_t cid : cell) {
-							// Ignore any ids greater than the box id, to make sure we only add a pairing once.
-							if (cid >= bidx) {
+							// In the first tier ignore any ids greater than the box id, to make sure we only add a pairing once.
+							// In the tiers above we no longer have to ignore any ids.
+							if (tier == ctier.msb && cid >= bidx) {
 								continue;
 							}
 
-							const bbox_t& other = bounds[cid];
-							if (bbox.overlaps(other)) {
-								// Add to the list.
-								list.push(ids[cid]);
+							// Another shared cell reports the pair, skip it before the box test.
+							// Pairs that don't overlap can pass this check, the box test drops them.
+							decltype(auto) other = boundsOf(cid);
+							if (!isReferenceCell(bbox, other, tier, loc)) {
+								PBD_HASHING_STAT(++counters.duplicates);
+								continue;
 							}
-						}
-					});
 
-					ctier.b0 /= 2;
-					ctier.b1 /= 2;
-				}
-
-				for (index_t tier = ctier.msb+1, ntiers = tier_limit; tier < ntiers; ++tier) {
-					// For each cell the bound occupies, find it in the table
-					applyAllCells(ctier.b0, ctier.b1, [&](const ivec_t& loc) {
-						// Find the cell 'loc' in the table.
-						CellRange cell = find(tier, loc);
-
-						// For each element in the range, check if it overlaps.
-						for (index_t cid : cell) {
-							// No longer have to ignore any ids.
-
-							const bbox_t& other = bounds[cid];
-							if (bbox.overlaps(other)) {
-								// Add to the list.
-								list.push(ids[cid]);
-							}
+							PBD_HASHING_STAT(++counters.candidates);
+							batch.add(bbox, other, Candidate{ cid }, onOverlap);
 						}
 					});
 
-					ctier.b0 /= 2;
-					ctier.b1 /= 2;
+					ctier.b0 = coarsen(ctier.b0, 1);
+					ctier.b1 = coarsen(ctier.b1, 1);
 				}
-				list.ungroup();
+
+				batch.flush(bbox, onOverlap);
+				sink.end();
 			}
 
-			// Done
+			PBD_HASHING_STAT(result += counters);
 		}
 
 	protected:
@@ -262,15 +527,67 @@ namespace pbd {
 		map_t cell_map;
 		entries_t cell_entries;
 		size_t tier_limit;
+		// Kept whatever PBD_HASHING_STATS is, so the layout of the table doesn't depend on it.
+		QueryStats queries;
 
 		struct ClassifiedTier {
 			ivec_t b0, b1;
 			index_t msb;
 		};
-		ClassifiedTier classify(const bbox_t & bbox) {
+		std::vector<ClassifiedTier> classified;
+		std::vector<ivec_t> lows, highs;
+		detail::PartitionedQuery<index_t> partitioned;
+
+		// Classify the tier of every object from the cells in lows and highs.
+		void classifyAll(size_t count) {
+			// Kept between builds, so the passes below don't have to classify every bound twice.
+			classified.resize(count);
+			for (size_t i = 0; i < count; ++i) {
+				classified[i] = classify(lows[i], highs[i]);
+			}
+		}
+		// Count the entries of every cell, then insert the classified objects into their tier.
+		void buildClassified(size_t count) {
+			size_t element_count = 0;
+			cell_map.clear();
+			cell_entries.clear();
+
+			{
+				PBD_HASHING_TRACE_SCOPE("HTable::count");
+				for (const ClassifiedTier& ctier : classified) {
+					applyAllCells(ctier.b0, ctier.b1, [&](const ivec_t & vec){
+						auto it = cell_map.find(Cell{ctier.msb, vec});
+						if (it == cell_map.end()) {
+							// We start at 2, to reserve a place for the entry count.
+							// We put it in the entry list so the elements in the cell map are as small as possible.
+							cell_map.insert(it, { Cell{ctier.msb, vec}, 2});
+							element_count += 2;
+						}
+						else {
+							++element_count;
+							++it->second;
+						}
+					});
+				}
+			}
+
+			prepareCellEntries(element_count);
+
+			PBD_HASHING_TRACE_SCOPE("HTable::insert");
+			for (size_t i = 0; i < count; ++i) {
+				const ClassifiedTier& ctier = classified[i];
+				insert(static_cast<index_t>(i), ctier.msb, ctier.b0, ctier.b1);
+			}
+		}
+
+		ClassifiedTier classify(const bbox_t & bbox) const {
+			return classify(grid.calcCell(bbox.min), grid.calcCell(bbox.max));
+		}
+		// Same as above, from the cells of the min and max corners in the first tier.
+		ClassifiedTier classify(const ivec_t& b0, const ivec_t& b1) const {
 			ClassifiedTier result;
-			result.b0 = grid.calcCell(bbox.min);
-			result.b1 = grid.calcCell(bbox.max);
+			result.b0 = b0;
+			result.b1 = b1;
 
 			ivec_t size = result.b1 - result.b0;
 			index_t l = 0;
@@ -288,21 +605,34 @@ namespace pbd {
 			}
 
 			result.msb = tier;
-			index_t factor = 1 << result.msb;
-			for (int i = 0; i < Dims; ++i) {
-				result.b0[i] /= factor;
-				result.b1[i] /= factor;
-			}
+			result.b0 = coarsen(result.b0, result.msb);
+			result.b1 = coarsen(result.b1, result.msb);
+
+			return result;
+		}
 
+		// Convert a cell index from the first tier into the given tier.
+		// Shifting floors negative cells as well, so the tiers stay nested on both sides of the origin.
+		static ivec_t coarsen(const ivec_t& vec, index_t tier) {
+			ivec_t result;
+			for (glm::length_t i = 0; i < Dims; ++i) {
+				result[i] = vec[i] >> tier;
+			}
 			return result;
 		}
 
+		// True if 'loc' is the cell of the given tier that owns the pairing of a and b.
+		// Assumes the boxes overlap, so the reference point lies inside both of them.
+		bool isReferenceCell(const bbox_t& a, const bbox_t& b, index_t tier, const ivec_t& loc) const {
+			return coarsen(grid.calcCell(glm::max(a.min, b.min)), tier) == loc;
+		}
+
 		void count(index_t tier, const ivec_t& vec, int64_t& totalEntries) {
-			auto it = cellMap.find(vec);
-			if (it == cellMap.end()) {
+			auto it = cell_map.find(Cell{ tier, vec });
+			if (it == cell_map.end()) {
 				// We start at 2, to reserve a place for the entry count.
 				// We put it in the entry list so the elements in the cell map are as small as possible.
-				cell_map.insert(it, { tier, vec, 2 });
+				cell_map.insert(it, { Cell{ tier, vec }, 2 });
 				totalEntries += 2;
 			}
 			else {
@@ -316,6 +646,7 @@ namespace pbd {
 			});
 		}
 		void prepareCellEntries(int64_t totalEntries) {
+			PBD_HASHING_TRACE_SCOPE("HTable::prefix");
 			cell_entries.resize(totalEntries, 0);
 
 			// Early out.
@@ -326,21 +657,22 @@ namespace pbd {
 			int64_t tot = 0;
 			for (auto& kv : cell_map) {
 				// ecount is the number of entries this cell is going to use, including the first entry that holds ecount-1.
-				index_t ecount = kv.second;
+				offset_t ecount = kv.second;
 
 				// Remap the cell to the current index in the entry list.
-				kv.second = static_cast<index_t>(tot);
+				kv.second = static_cast<offset_t>(tot);
 
 				// Move to the next open position in the entry list.
 				tot += ecount;
-				// Make sure we aren't over the limit.
-				assert(tot < MaxIndex);
+				// Make sure we aren't over the limit, the entries of a single cell are counted with the index type.
+				assert(static_cast<uint64_t>(tot) < MaxOffset);
+				assert(ecount < MaxIndex);
 
 				// First entry is the number of ids in the cell.
-				cell_entries[kv.second] = ecount - 1;
+				cell_entries[kv.second] = static_cast<index_t>(ecount - 1);
 
 				// We use this value in the next step to make sure we insert everything correctly.
-				cell_entries[kv.second + 1] = ecount - 1;
+				cell_entries[kv.second + 1] = static_cast<index_t>(ecount - 1);
 			}
 		}
 		CellRange find(index_t tier, const ivec_t& vec) const {
@@ -356,7 +688,7 @@ namespace pbd {
 			assert(cell_map.contains(Cell{tier, vec}));
 
 			// Grab the index associated with this vec
-			index_t start = cell_map[Cell{tier, vec}];
+			offset_t start = cell_map[Cell{tier, vec}];
 
 			// The offset to the end of the cell entries range.
 			index_t& old_offset = cell_entries[start + 1];
@@ -385,7 +717,7 @@ namespace pbd {
 				: mfirst(nullptr)
 				, mlast(nullptr)
 			{}
-			CellRange(const entries_t& list, index_t index)
+			CellRange(const entries_t& list, offset_t index)
 			{
 				mfirst = list.data() + index;
 				mlast = mfirst + (*mfirst);
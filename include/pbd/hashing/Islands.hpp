@@ -0,0 +1,227 @@
+#pragma once
+#include <cinttypes>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cassert>
+#include <pbd/hashing/util.hpp>
+#include <pbd/hashing/Executor.hpp>
+#include <pbd/hashing/OverlapList.hpp>
+#include <pbd/hashing/OverlapSink.hpp>
+
+namespace pbd {
+	// Connected components (islands) of the overlap graph.
+	// Uses a lock-free union-find, so the pairs can be merged from several threads at once.
+	// After building, the ids are compacted so the members of each island are contiguous.
+	template<typename Index = int32_t>
+	class Islands {
+	public:
+		using index_t = Index;
+
+		class Island;
+
+		// Build the islands for ids in the range [0, nids).
+		// The list has to be indexed (see OverlapList::setIndexed) to be processed by more than one thread.
+		// The thread count versions run on ThreadPool::global().
+		void build(const OverlapList& list, size_t nids, size_t threads = 1) {
+			build(list, nids, detail::ThreadCountExecutor(threads));
+		}
+		void build(const PairList<index_t>& pairs, size_t nids, size_t threads = 1) {
+			build(pairs, nids, detail::ThreadCountExecutor(threads));
+		}
+
+		// Same as above, running the parallel parts through the executor, see Executor.hpp.
+		template<typename Executor, detail::enable_if_executor_t<Executor> = 0>
+		void build(const OverlapList& list, size_t nids, Executor&& executor) {
+			reset(nids);
+
+			size_t parts = executor.concurrency();
+			if (list.isIndexed() && parts > 1) {
+				std::vector<size_t> bounds = list.split(parts);
+				detail::parallelRanges(executor, parts, parts, [&](size_t first, size_t last, size_t) {
+					for (size_t part = first; part < last; ++part) {
+						uniteGroups(list.at(bounds[part]), list.at(bounds[part + 1]));
+					}
+				});
+			}
+			else {
+				uniteGroups(list.begin(), list.end());
+			}
+
+			compact(executor);
+		}
+		template<typename Executor, detail::enable_if_executor_t<Executor> = 0>
+		void build(const PairList<index_t>& pairs, size_t nids, Executor&& executor) {
+			reset(nids);
+
+			detail::parallelRanges(executor, pairs.size(), executor.concurrency(), [&](size_t first, size_t last, size_t) {
+				for (size_t i = first; i < last; ++i) {
+					unite(pairs[i].first, pairs[i].second);
+				}
+			});
+
+			compact(executor);
+		}
+
+		void clear() {
+			nodes = 0;
+			islandIds.clear();
+			islandOffsets.clear();
+			islands.clear();
+		}
+
+		// Number of islands, ids without any overlaps are islands of their own.
+		size_t size() const noexcept {
+			return islandOffsets.empty() ? 0 : islandOffsets.size() - 1;
+		}
+		// Number of ids the islands were built for.
+		size_t numIds() const noexcept {
+			return nodes;
+		}
+
+		Island operator[](size_t island) const noexcept {
+			assert(island < size());
+			return Island(islandIds.data() + islandOffsets[island], islandIds.data() + islandOffsets[island + 1]);
+		}
+		// The island an id belongs to.
+		index_t islandOf(index_t id) const noexcept {
+			assert(id >= 0 && static_cast<size_t>(id) < nodes);
+			return islands[id];
+		}
+
+		// All the ids grouped by island, island i is [offsets[i], offsets[i+1]).
+		const std::vector<index_t>& getIds() const noexcept {
+			return islandIds;
+		}
+		const std::vector<index_t>& getOffsets() const noexcept {
+			return islandOffsets;
+		}
+
+		class Island {
+		public:
+			Island(const index_t* _first, const index_t* _last)
+				: mfirst(_first)
+				, mlast(_last)
+			{}
+
+			size_t size() const noexcept {
+				return mlast - mfirst;
+			}
+			bool empty() const noexcept {
+				return mfirst == mlast;
+			}
+
+			const index_t& operator[](int32_t i) const noexcept {
+				assert(i >= 0 && i < size());
+				return mfirst[i];
+			}
+
+			const index_t* begin() const noexcept {
+				return mfirst;
+			}
+			const index_t* end() const noexcept {
+				return mlast;
+			}
+		private:
+			const index_t* mfirst, * mlast;
+		};
+	private:
+		void reset(size_t nids) {
+			if (capacity < nids) {
+				parents.reset(new std::atomic<index_t>[nids]);
+				capacity = nids;
+			}
+			nodes = nids;
+			for (size_t i = 0; i < nids; ++i) {
+				parents[i].store(static_cast<index_t>(i), std::memory_order_relaxed);
+			}
+		}
+
+		// Find with path halving, other threads may be linking roots at the same time.
+		index_t find(index_t id) {
+			while (true) {
+				index_t parent = parents[id].load(std::memory_order_relaxed);
+				if (parent == id) {
+					return id;
+				}
+				index_t grand = parents[parent].load(std::memory_order_relaxed);
+				if (parent != grand) {
+					// Failure just means another thread got to it first, the structure is still valid.
+					parents[id].compare_exchange_weak(parent, grand, std::memory_order_relaxed);
+				}
+				id = grand;
+			}
+		}
+		void unite(index_t a, index_t b) {
+			assert(a >= 0 && static_cast<size_t>(a) < nodes);
+			assert(b >= 0 && static_cast<size_t>(b) < nodes);
+			while (true) {
+				a = find(a);
+				b = find(b);
+				if (a == b) {
+					return;
+				}
+				// Always link the larger root below the smaller one, so no cycles can form.
+				if (a < b) {
+					std::swap(a, b);
+				}
+				index_t expected = a;
+				if (parents[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) {
+					return;
+				}
+			}
+		}
+		void uniteGroups(OverlapList::const_iterator it, OverlapList::const_iterator last) {
+			for (; it != last; ++it) {
+				auto overlaps = *it;
+				index_t first = static_cast<index_t>(overlaps.front());
+				for (size_t i = 1; i < overlaps.size(); ++i) {
+					unite(first, static_cast<index_t>(overlaps[i]));
+				}
+			}
+		}
+
+		template<typename Executor>
+		void compact(Executor& executor) {
+			// Flatten every id to its root.
+			islands.resize(nodes);
+			detail::parallelRanges(executor, nodes, executor.concurrency(), [&](size_t first, size_t last, size_t) {
+				for (size_t i = first; i < last; ++i) {
+					islands[i] = find(static_cast<index_t>(i));
+				}
+			});
+
+			// Number the roots in order, roots are always the smallest id in their island so they are visited first.
+			islandOffsets.clear();
+			islandOffsets.push_back(0);
+			for (size_t i = 0; i < nodes; ++i) {
+				index_t root = islands[i];
+				if (root == static_cast<index_t>(i)) {
+					islands[i] = static_cast<index_t>(islandOffsets.size() - 1);
+					islandOffsets.push_back(0);
+				}
+				else {
+					islands[i] = islands[root];
+				}
+				++islandOffsets[islands[i] + 1];
+			}
+			for (size_t i = 1; i < islandOffsets.size(); ++i) {
+				islandOffsets[i] += islandOffsets[i - 1];
+			}
+
+			// Counting sort the ids into their islands, ids stay in increasing order within an island.
+			islandIds.resize(nodes);
+			std::vector<index_t> cursor(islandOffsets.begin(), islandOffsets.end() - 1);
+			for (size_t i = 0; i < nodes; ++i) {
+				islandIds[cursor[islands[i]]++] = static_cast<index_t>(i);
+			}
+		}
+
+		std::unique_ptr<std::atomic<index_t>[]> parents;
+		size_t capacity = 0, nodes = 0;
+
+		std::vector<index_t> islands;
+		std::vector<index_t> islandIds;
+		std::vector<index_t> islandOffsets;
+	};
+}
@@ -2,6 +2,7 @@
 #include <cinttypes>
 #include <vector>
 #include <cassert>
+#include <algorithm>
 #include <parallel_hashmap/phmap.h>
 
 namespace pbd {
@@ -9,8 +10,16 @@ namespace pbd {
 	public:
 		using index_t = int32_t;
 		using container_t = std::vector<index_t>;
+		using stamp_t = uint32_t;
 		using set_t = phmap::flat_hash_set<index_t>;
 
+		// Groups smaller than this are deduplicated with a linear scan of the group itself.
+		// Larger groups switch over to the generation stamps, or to a hash set when the ids are too sparse for them.
+		static constexpr index_t SmallGroup = 8;
+		// The stamps grow to cover any id below this, or below a few times the size of the list, whichever is larger.
+		// Ids past that (or negative ones) send the group to the hash set, so a single large id doesn't allocate stamps for every id below it.
+		static constexpr size_t DenseIds = size_t(1) << 16;
+
 		class Overlaps;
 		class const_iterator;
 
@@ -22,6 +31,9 @@ namespace pbd {
 
 		OverlapList()
 			: count(0)
+			, generation(1)
+			, mode(Dedupe::Scan)
+			, indexed(false)
 		{
 #ifndef NDEBUG
 			inGroup = false;
@@ -31,6 +43,7 @@ namespace pbd {
 		void clear() {
 			count = 0;
 			list.clear();
+			groups.clear();
 		}
 		bool empty() const noexcept {
 			return count == 0;
@@ -39,6 +52,80 @@ namespace pbd {
 			return count;
 		}
 
+		// Total number of pairs stored in the list, a group of n ids holds n-1 pairs.
+		size_t numPairs() const noexcept {
+			// Each group uses its size plus one entries in the list.
+			return list.size() - 2 * count;
+		}
+
+		// Keep the offset of every group, to allow random access and splitting the list into balanced ranges.
+		// Enabling the index on a list that already has groups in it walks the list once.
+		void setIndexed(bool value) {
+			indexed = value;
+			groups.clear();
+			if (indexed) {
+				groups.reserve(count);
+				for (size_t offset = 0; offset < list.size(); offset += list[offset] + 1) {
+					groups.push_back(offset);
+				}
+			}
+		}
+		bool isIndexed() const noexcept {
+			return indexed;
+		}
+
+		// Random access to the groups, requires the index to be enabled.
+		Overlaps operator[](size_t group) const noexcept {
+			assert(indexed && group < count);
+			return Overlaps(list.data() + groups[group]);
+		}
+		// Iterator to the given group, 'size()' gives the end iterator. Requires the index to be enabled.
+		const_iterator at(size_t group) const noexcept {
+			assert(indexed && group <= count);
+			if (group == count) {
+				return end();
+			}
+			return const_iterator(list.begin() + groups[group]);
+		}
+
+		// Split the groups into 'parts' consecutive ranges holding roughly the same number of pairs.
+		// Returns parts+1 group indices, range i is [result[i], result[i+1]). Requires the index to be enabled.
+		std::vector<size_t> split(size_t parts) const {
+			assert(indexed);
+			assert(parts > 0);
+
+			std::vector<size_t> bounds(parts + 1, count);
+			bounds[0] = 0;
+
+			size_t total = numPairs();
+			size_t group = 0;
+			for (size_t i = 1; i < parts; ++i) {
+				size_t target = (total * i) / parts;
+
+				// Find the first group whose preceding pairs reach the target.
+				size_t first = group, last = count;
+				while (first < last) {
+					size_t mid = first + (last - first) / 2;
+					if (pairsBefore(mid) < target) {
+						first = mid + 1;
+					}
+					else {
+						last = mid;
+					}
+				}
+				group = first;
+				bounds[i] = group;
+			}
+			return bounds;
+		}
+
+		// Size the dedupe stamps for ids in the range [0, nids), so push never has to grow them.
+		void reserveIds(size_t nids) {
+			if (stamps.size() < nids) {
+				stamps.resize(nids, 0);
+			}
+		}
+
 		void group() {
 			assert(!inGroup);
 #ifndef NDEBUG
@@ -49,12 +136,42 @@ namespace pbd {
 		}
 		void push(index_t idx) {
 			assert(inGroup);
-			auto result = gset.insert(idx);
-			if(result.second) {
-				index_t offset = list.back();
-				list.back() = idx;
-				list.push_back(offset + 1);
+			assert(idx >= 0);
+
+			// The last entry holds the group size plus one, the group itself is right before it.
+			index_t offset = list.back();
+			if (mode == Dedupe::Scan) {
+				const index_t* first = list.data() + list.size() - offset;
+				const index_t* last = list.data() + list.size() - 1;
+				if (std::find(first, last, idx) != last) {
+					return;
+				}
+				if (offset == SmallGroup) {
+					// Group is about to outgrow the linear scan, mark everything thats in it so far.
+					mode = Dedupe::Stamps;
+					for (; first != last; ++first) {
+						mark(*first);
+					}
+					mark(idx);
+				}
+			}
+			else if (!mark(idx)) {
+				return;
+			}
+
+			list.back() = idx;
+			list.push_back(offset + 1);
+		}
+		// Push an id the caller guarantees is not already in the group, skips the dedupe scan entirely.
+		void pushUnique(index_t idx) {
+			assert(inGroup);
+			assert(idx >= 0);
+			if (mode != Dedupe::Scan) {
+				mark(idx);
 			}
+			index_t offset = list.back();
+			list.back() = idx;
+			list.push_back(offset + 1);
 		}
 		void ungroup() {
 			assert(inGroup);
@@ -82,9 +199,39 @@ namespace pbd {
 
 				list.pop_back();
 				++count;
+
+				if (indexed) {
+					groups.push_back(index);
+				}
 			}
 
-			gset.clear();
+			if (mode != Dedupe::Scan) {
+				// Moving to the next generation invalidates every stamp at once.
+				// A group that moved on to the set may have stamped some ids before that, so the generation moves either way.
+				if (mode == Dedupe::Set) {
+					gset.clear();
+				}
+				mode = Dedupe::Scan;
+				if (++generation == 0) {
+					std::fill(stamps.begin(), stamps.end(), stamp_t(0));
+					generation = 1;
+				}
+			}
+		}
+
+		// Add all the groups of another list at the end of this one, used to join lists filled in parallel.
+		void append(const OverlapList& other) {
+			assert(!inGroup);
+			size_t base = list.size();
+			list.insert(list.end(), other.list.begin(), other.list.end());
+			count += other.count;
+
+			if (indexed) {
+				groups.reserve(count);
+				for (size_t offset = base; offset < list.size(); offset += list[offset] + 1) {
+					groups.push_back(offset);
+				}
+			}
 		}
 
 		const_iterator begin() const noexcept {
@@ -190,11 +337,75 @@ namespace pbd {
 			container_t::const_iterator it;
 		};
 	private:
+		// Number of pairs stored in the groups before the given one.
+		size_t pairsBefore(size_t group) const noexcept {
+			if (group == count) {
+				return numPairs();
+			}
+			return groups[group] - 2 * group;
+		}
+
+		// Returns false if the id was already marked for the current large group.
+		bool mark(index_t idx) {
+			if (mode == Dedupe::Stamps && !fitsStamps(idx)) {
+				toSet();
+			}
+			if (mode == Dedupe::Set) {
+				return gset.insert(idx).second;
+			}
+
+			stamp_t& value = stamps[idx];
+			if (value == generation) {
+				return false;
+			}
+			value = generation;
+			return true;
+		}
+		// Grows the stamps to cover the id when it is dense enough, see DenseIds.
+		bool fitsStamps(index_t idx) {
+			if (idx < 0) {
+				return false;
+			}
+			size_t id = static_cast<size_t>(idx);
+			if (id < stamps.size()) {
+				return true;
+			}
+			if (id >= std::max({ DenseIds, stamps.size() * 2, list.size() * 4 })) {
+				return false;
+			}
+			stamps.resize(std::max(id + 1, stamps.size() * 2), 0);
+			return true;
+		}
+		// Move the current group over to the hash set, from the ids already in the list.
+		void toSet() {
+			mode = Dedupe::Set;
+			gset.clear();
+			const index_t* first = list.data() + list.size() - list.back();
+			const index_t* last = list.data() + list.size() - 1;
+			gset.insert(first, last);
+		}
+
 		size_t count;
 		container_t list;
-		// We may want to add a set to prevent duplicates from being added to the list.
+
+		// How the current group is deduplicated.
+		enum class Dedupe : uint8_t {
+			Scan,
+			Stamps,
+			Set,
+		};
+
+		// Dense per id generation stamps, used to prevent duplicates from being added to large groups.
+		std::vector<stamp_t> stamps;
+		stamp_t generation;
+		Dedupe mode;
+		// Ids of a large group whose ids don't fit the stamps.
 		set_t gset;
 
+		// Offset of every group in the list, only kept when indexed.
+		std::vector<size_t> groups;
+		bool indexed;
+
 #ifndef NDEBUG
 		bool inGroup;
 #endif
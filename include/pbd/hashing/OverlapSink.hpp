@@ -0,0 +1,297 @@
+#pragma once
+#include <cinttypes>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cassert>
+#include <type_traits>
+#include <pbd/hashing/OverlapList.hpp>
+#include <pbd/hashing/Executor.hpp>
+#include <pbd/hashing/Stats.hpp>
+
+namespace pbd {
+	// Flat list of overlapping id pairs, every pair appears once.
+	template<typename index_t>
+	using PairList = std::vector<std::pair<index_t, index_t>>;
+
+	// Symmetric compressed sparse row adjacency of the overlaps.
+	// Vertices are the ids themselves, so an id appears as a neighbor of every id it overlaps and vice versa.
+	template<typename Index>
+	class OverlapCSR {
+	public:
+		using index_t = Index;
+		using pair_t = std::pair<index_t, index_t>;
+
+		class Neighbors;
+
+		void clear() {
+			offsets.clear();
+			adjacency.clear();
+			pairs.clear();
+		}
+		// Preallocate room for the given number of vertices and pairs.
+		void reserve(size_t nvertices, size_t npairs) {
+			offsets.reserve(nvertices + 1);
+			adjacency.reserve(npairs * 2);
+			pairs.reserve(npairs);
+		}
+
+		// Number of vertices, which is one past the largest id seen.
+		size_t size() const noexcept {
+			return offsets.empty() ? 0 : offsets.size() - 1;
+		}
+		// Number of (undirected) pairs.
+		size_t numPairs() const noexcept {
+			return adjacency.size() / 2;
+		}
+
+		Neighbors operator[](index_t vertex) const noexcept {
+			assert(vertex >= 0 && static_cast<size_t>(vertex) < size());
+			return Neighbors(adjacency.data() + offsets[vertex], adjacency.data() + offsets[vertex + 1]);
+		}
+
+		const std::vector<index_t>& getOffsets() const noexcept {
+			return offsets;
+		}
+		const std::vector<index_t>& getAdjacency() const noexcept {
+			return adjacency;
+		}
+
+		// Build the adjacency from a list of pairs, using a counting sort on the vertices.
+		void assign(const pair_t* first, size_t npairs, size_t nvertices) {
+			offsets.clear();
+			offsets.resize(nvertices + 1, 0);
+			adjacency.resize(npairs * 2);
+
+			const pair_t* last = first + npairs;
+			for (const pair_t* it = first; it != last; ++it) {
+				assert(it->first >= 0 && static_cast<size_t>(it->first) < nvertices);
+				assert(it->second >= 0 && static_cast<size_t>(it->second) < nvertices);
+				++offsets[it->first + 1];
+				++offsets[it->second + 1];
+			}
+			for (size_t i = 1; i <= nvertices; ++i) {
+				offsets[i] += offsets[i - 1];
+			}
+
+			// Use the start of each range as the insertion cursor, then shift them back into place.
+			for (const pair_t* it = first; it != last; ++it) {
+				adjacency[offsets[it->first]++] = it->second;
+				adjacency[offsets[it->second]++] = it->first;
+			}
+			for (size_t i = nvertices; i > 0; --i) {
+				offsets[i] = offsets[i - 1];
+			}
+			offsets[0] = 0;
+		}
+		void assign(const std::vector<pair_t>& list, size_t nvertices) {
+			assign(list.data(), list.size(), nvertices);
+		}
+
+		// Scratch pair storage, used by the tables to collect the pairs before building the adjacency.
+		std::vector<pair_t>& scratch() noexcept {
+			return pairs;
+		}
+
+		class Neighbors {
+		public:
+			Neighbors(const index_t* _first, const index_t* _last)
+				: mfirst(_first)
+				, mlast(_last)
+			{}
+
+			size_t size() const noexcept {
+				return mlast - mfirst;
+			}
+			bool empty() const noexcept {
+				return mfirst == mlast;
+			}
+
+			const index_t& operator[](int32_t i) const noexcept {
+				assert(i >= 0 && i < size());
+				return mfirst[i];
+			}
+
+			const index_t* begin() const noexcept {
+				return mfirst;
+			}
+			const index_t* end() const noexcept {
+				return mlast;
+			}
+		private:
+			const index_t* mfirst, * mlast;
+		};
+	private:
+		std::vector<index_t> offsets;
+		std::vector<index_t> adjacency;
+		std::vector<pair_t> pairs;
+	};
+
+	namespace detail {
+		// Sinks receive the overlaps found by the tables, one query id at a time:
+		//	begin(id), then add(other) for every overlapping id, then end().
+		// The tables guarantee that every pair is only reported once.
+		// Once done() returns true the tables stop the query, ids added after that point have to be ignored by the sink.
+
+		struct OverlapListSink {
+			OverlapList& list;
+
+			template<typename index_t>
+			void begin(index_t id) {
+				list.group();
+				list.pushUnique(static_cast<OverlapList::index_t>(id));
+			}
+			template<typename index_t>
+			void add(index_t id) {
+				list.pushUnique(static_cast<OverlapList::index_t>(id));
+			}
+			void end() {
+				list.ungroup();
+			}
+			bool done() const noexcept {
+				return false;
+			}
+		};
+
+		template<typename index_t>
+		struct PairListSink {
+			PairList<index_t>& pairs;
+			index_t first;
+
+			void begin(index_t id) {
+				first = id;
+			}
+			void add(index_t id) {
+				pairs.emplace_back(first, id);
+			}
+			void end() {}
+			bool done() const noexcept {
+				return false;
+			}
+		};
+
+		// Hands every pair straight to the visitor, see forEachOverlap on the tables.
+		// A visitor returning bool stops the query when it returns false.
+		template<typename index_t, typename Visitor>
+		struct VisitorSink {
+			Visitor& visitor;
+			index_t first;
+			bool stopped;
+
+			void begin(index_t id) {
+				first = id;
+			}
+			void add(index_t id) {
+				if constexpr (std::is_void_v<decltype(visitor(first, id))>) {
+					visitor(first, id);
+				}
+				else {
+					if (!stopped && !visitor(first, id)) {
+						stopped = true;
+					}
+				}
+			}
+			void end() {}
+			bool done() const noexcept {
+				return stopped;
+			}
+		};
+
+		// Runs a query over the boxes in parts through an executor, each part writing to its own output.
+		// The outputs are joined in order afterwards, so the result is the same as a serial query.
+		// query(first, last, sink, counters) must only read the table.
+		template<typename index_t>
+		class PartitionedQuery {
+		public:
+			template<typename Executor, typename Query>
+			QueryStats run(Executor& executor, size_t count, PairList<index_t>& pairs, Query&& query) {
+				size_t nparts = partsFor(executor, count);
+				pairParts.resize(nparts);
+				counters.assign(nparts, QueryStats{});
+
+				detail::parallelRanges(executor, count, nparts, [&](size_t first, size_t last, size_t part) {
+					PairList<index_t>& local = pairParts[part];
+					local.clear();
+					PairListSink<index_t> sink{ local, 0 };
+					query(first, last, sink, counters[part]);
+				});
+
+				// Copy the parts into place, in parallel as well since the lists can be long.
+				offsets.resize(nparts + 1);
+				offsets[0] = 0;
+				for (size_t part = 0; part < nparts; ++part) {
+					offsets[part + 1] = offsets[part] + pairParts[part].size();
+				}
+				pairs.resize(offsets[nparts]);
+				executor.parallel_for(0, nparts, 1, [&](size_t first, size_t last) {
+					for (size_t part = first; part < last; ++part) {
+						std::copy(pairParts[part].begin(), pairParts[part].end(), pairs.begin() + offsets[part]);
+					}
+				});
+				return total();
+			}
+			template<typename Executor, typename Query>
+			QueryStats run(Executor& executor, size_t count, OverlapList& list, Query&& query) {
+				size_t nparts = partsFor(executor, count);
+				listParts.resize(nparts);
+				counters.assign(nparts, QueryStats{});
+
+				detail::parallelRanges(executor, count, nparts, [&](size_t first, size_t last, size_t part) {
+					OverlapList& local = listParts[part];
+					local.clear();
+					OverlapListSink sink{ local };
+					query(first, last, sink, counters[part]);
+				});
+
+				list.clear();
+				for (size_t part = 0; part < nparts; ++part) {
+					list.append(listParts[part]);
+				}
+				return total();
+			}
+		private:
+			// Several parts per thread, so a part full of large boxes doesn't hold up the others.
+			template<typename Executor>
+			static size_t partsFor(Executor& executor, size_t count) {
+				size_t concurrency = std::max<size_t>(1, executor.concurrency());
+				size_t parts = concurrency == 1 ? 1 : concurrency * 4;
+				return std::max<size_t>(1, std::min(parts, count));
+			}
+			QueryStats total() const {
+				QueryStats result;
+				for (const QueryStats& part : counters) {
+					result += part;
+				}
+				return result;
+			}
+
+			std::vector<PairList<index_t>> pairParts;
+			std::vector<OverlapList> listParts;
+			std::vector<size_t> offsets;
+			std::vector<QueryStats> counters;
+		};
+
+		// Clear the output and run query(sink) with the matching sink, for the parallel paths that fall back to a serial query.
+		template<typename index_t, typename Query>
+		void serialQuery(PairList<index_t>& pairs, Query&& query) {
+			pairs.clear();
+			PairListSink<index_t> sink{ pairs, 0 };
+			query(sink);
+		}
+		template<typename Query>
+		void serialQuery(OverlapList& list, Query&& query) {
+			list.clear();
+			OverlapListSink sink{ list };
+			query(sink);
+		}
+
+		template<typename index_t>
+		size_t vertexCount(const index_t* ids, size_t count) {
+			index_t largest = -1;
+			for (const index_t* it = ids, * last = ids + count; it != last; ++it) {
+				largest = std::max(largest, *it);
+			}
+			return static_cast<size_t>(largest + 1);
+		}
+	}
+}
@@ -0,0 +1,174 @@
+#pragma once
+#include <cinttypes>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <pbd/hashing/OverlapList.hpp>
+#include <pbd/hashing/OverlapSink.hpp>
+
+namespace pbd {
+	// Persistent set of overlapping pairs, kept from one frame to the next.
+	// Every frame the pairs are submitted between begin() and end(), then the cache reports
+	// which pairs are new, which persisted from the previous frame, and which ended.
+	// Each pair carries a payload (contact data for warm starting, etc.) that stays attached as long as the pair persists.
+	//
+	// Pairs are stored sorted by their packed ids, so updating is a sort of the new pairs and a linear merge, no hashing.
+	template<typename Payload, typename Index = int32_t>
+	class PairCache {
+	public:
+		using index_t = Index;
+		using payload_t = Payload;
+		using key_t = uint64_t;
+
+		static_assert(sizeof(index_t) <= 4, "pbd::PairCache packs both ids of a pair into 64 bits!");
+
+		struct Entry {
+			index_t first, second;
+			payload_t payload;
+		};
+
+		// Start collecting the pairs for a new frame.
+		void begin() {
+			assert(!inFrame);
+			inFrame = true;
+			pending.clear();
+		}
+
+		void add(index_t a, index_t b) {
+			assert(inFrame);
+			assert(a != b);
+			pending.push_back(makeKey(a, b));
+		}
+		void add(const OverlapList& list) {
+			for (auto overlaps : list) {
+				index_t first = static_cast<index_t>(overlaps.front());
+				for (size_t i = 1; i < overlaps.size(); ++i) {
+					add(first, static_cast<index_t>(overlaps[i]));
+				}
+			}
+		}
+		void add(const PairList<index_t>& pairs) {
+			for (const auto& pair : pairs) {
+				add(pair.first, pair.second);
+			}
+		}
+
+		// Finish the frame, merging the new pairs with the cached ones.
+		void end() {
+			assert(inFrame);
+			inFrame = false;
+
+			std::sort(pending.begin(), pending.end());
+			pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+
+			madded.clear();
+			mpersisting.clear();
+			mremoved.clear();
+
+			next.clear();
+			next.reserve(pending.size());
+
+			auto old = entries.begin(), oldEnd = entries.end();
+			auto cur = pending.begin(), curEnd = pending.end();
+			while (cur != curEnd) {
+				if (old == oldEnd || *cur < keyOf(*old)) {
+					madded.push_back(next.size());
+					next.push_back(makeEntry(*cur, payload_t{}));
+					++cur;
+				}
+				else if (keyOf(*old) < *cur) {
+					mremoved.push_back(std::move(*old));
+					++old;
+				}
+				else {
+					mpersisting.push_back(next.size());
+					next.push_back(std::move(*old));
+					++old;
+					++cur;
+				}
+			}
+			for (; old != oldEnd; ++old) {
+				mremoved.push_back(std::move(*old));
+			}
+
+			std::swap(entries, next);
+		}
+
+		void clear() {
+			entries.clear();
+			next.clear();
+			pending.clear();
+			madded.clear();
+			mpersisting.clear();
+			mremoved.clear();
+		}
+
+		// Number of pairs in the current frame.
+		size_t size() const noexcept {
+			return entries.size();
+		}
+		bool empty() const noexcept {
+			return entries.empty();
+		}
+
+		// All the pairs of the current frame, sorted. The first id of each pair is always the smaller one.
+		std::vector<Entry>& pairs() noexcept {
+			return entries;
+		}
+		const std::vector<Entry>& pairs() const noexcept {
+			return entries;
+		}
+		Entry& operator[](size_t i) noexcept {
+			return entries[i];
+		}
+		const Entry& operator[](size_t i) const noexcept {
+			return entries[i];
+		}
+
+		// Indices into pairs() of the pairs that started this frame, their payloads are default constructed.
+		const std::vector<size_t>& added() const noexcept {
+			return madded;
+		}
+		// Indices into pairs() of the pairs that were also present last frame, with their payloads carried over.
+		const std::vector<size_t>& persisting() const noexcept {
+			return mpersisting;
+		}
+		// Pairs that ended this frame, along with their final payloads.
+		const std::vector<Entry>& removed() const noexcept {
+			return mremoved;
+		}
+
+		// Find a pair in the current frame, returns nullptr if its not present.
+		const Entry* find(index_t a, index_t b) const {
+			key_t key = makeKey(a, b);
+			auto it = std::lower_bound(entries.begin(), entries.end(), key, [](const Entry& entry, key_t value) {
+				return keyOf(entry) < value;
+			});
+			if (it != entries.end() && keyOf(*it) == key) {
+				return &*it;
+			}
+			return nullptr;
+		}
+	private:
+		static key_t makeKey(index_t a, index_t b) noexcept {
+			if (b < a) {
+				std::swap(a, b);
+			}
+			return (key_t(static_cast<uint32_t>(a)) << 32) | key_t(static_cast<uint32_t>(b));
+		}
+		static key_t keyOf(const Entry& entry) noexcept {
+			return makeKey(entry.first, entry.second);
+		}
+		static Entry makeEntry(key_t key, payload_t&& payload) {
+			return Entry{ static_cast<index_t>(key >> 32), static_cast<index_t>(key & 0xFFFFFFFF), std::move(payload) };
+		}
+
+		std::vector<Entry> entries, next;
+		std::vector<key_t> pending;
+
+		std::vector<size_t> madded, mpersisting;
+		std::vector<Entry> mremoved;
+
+		bool inFrame = false;
+	};
+}
@@ -0,0 +1,292 @@
+#pragma once
+#include <cinttypes>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include <pbd/hashing/Grid.hpp>
+#include <pbd/common/BBox.hpp>
+#include <pbd/hashing/BaseTable.hpp>
+#include <pbd/hashing/BBoxBatch.hpp>
+#include <pbd/hashing/OverlapList.hpp>
+#include <pbd/hashing/OverlapSink.hpp>
+
+namespace pbd {
+	// How objects are assigned to the partitions of a PartitionTable, see design.md.
+	enum class Encapsulation {
+		// Objects are added to every partition they are even partially inside of.
+		Partial,
+		// Objects are added only to a single partition that fully contains them.
+		// Objects that don't fit into any partition are leftovers, and get handled with partial encapsulation.
+		Total,
+	};
+
+	// Cyclic overlap partitioning, as described in design.md.
+	// Along each axis there is a cyclic set of partitions, each one two grid cells wide, starting at every grid cell.
+	// So partition k covers cells k and k+1, and neighboring partitions overlap by half.
+	// Objects are keyed by the indices of the partitions they belong to.
+	// The hyperplanes are evenly spaced, design.md leaves the spacing free. suggestGrid places them from the bounds:
+	// the spacing from the box sizes, and the phase from a plane through the median of the box centers,
+	// moved by a fraction of the spacing when that leaves fewer boxes cut across more than one plane.
+	template<typename Scalar, typename Index, glm::length_t L>
+	class PartitionTable {
+	public:
+		using scalar_t = Scalar;
+		using index_t = Index;
+		static constexpr glm::length_t Dims = L;
+		using grid_t = Grid<index_t, Dims, scalar_t>;
+		using bbox_t = BBox<Dims, scalar_t>;
+		using vec_t = typename grid_t::vec_t;
+		using ivec_t = typename grid_t::ivec_t;
+
+		using subtable_t = BaseTable<scalar_t, index_t, Dims>;
+		using CellRange = typename subtable_t::CellRange;
+
+		PartitionTable()
+			: policy(Encapsulation::Total)
+		{}
+		PartitionTable(const vec_t& spacing, Encapsulation _policy)
+		{
+			initialize(spacing, _policy);
+		}
+
+		// The spacing is the distance between two consecutive partitions along each axis, the partitions are twice as wide.
+		void initialize(const vec_t& spacing, Encapsulation _policy) {
+			initialize(grid_t(spacing), _policy);
+		}
+		void initialize(const grid_t& _grid, Encapsulation _policy) {
+			grid = _grid;
+			policy = _policy;
+			clear();
+		}
+
+		// Choose a spacing from the sizes of the bounds, such that the given fraction of them
+		// fits entirely into a single partition along each axis.
+		static vec_t suggestSpacing(const bbox_t* const bounds, size_t count, scalar_t fraction = scalar_t(0.9)) {
+			vec_t spacing(1);
+			if (count == 0) {
+				return spacing;
+			}
+
+			std::vector<scalar_t> sizes(count);
+			size_t nth = std::min(count - 1, static_cast<size_t>(fraction * count));
+			for (glm::length_t i = 0; i < Dims; ++i) {
+				for (size_t j = 0; j < count; ++j) {
+					sizes[j] = bounds[j].max[i] - bounds[j].min[i];
+				}
+				std::nth_element(sizes.begin(), sizes.begin() + nth, sizes.end());
+				spacing[i] = std::max(sizes[nth], scalar_t(1e-4));
+			}
+			return spacing;
+		}
+
+		// Phase of the hyperplanes along each axis for the given spacing, as the origin of the grid.
+		// The search starts from a plane through the median of the box centers, which splits the objects in half,
+		// then tries a few shifts of that plane and keeps the one with the fewest boxes that don't fit into a single partition.
+		static vec_t suggestOrigin(const bbox_t* const bounds, size_t count, const vec_t& spacing) {
+			// Shifts tried within one spacing.
+			constexpr int NumPhases = 8;
+
+			vec_t origin(0);
+			if (count == 0) {
+				return origin;
+			}
+
+			std::vector<scalar_t> centers(count);
+			for (glm::length_t i = 0; i < Dims; ++i) {
+				for (size_t j = 0; j < count; ++j) {
+					centers[j] = (bounds[j].min[i] + bounds[j].max[i]) * scalar_t(0.5);
+				}
+				std::nth_element(centers.begin(), centers.begin() + count / 2, centers.end());
+				scalar_t median = centers[count / 2];
+
+				// Boxes spanning more than two cells along the axis, then the planes crossed, lowest first.
+				std::pair<size_t, size_t> best{ count + 1, 0 };
+				for (int k = 0; k < NumPhases; ++k) {
+					scalar_t phase = median + spacing[i] * static_cast<scalar_t>(k) / static_cast<scalar_t>(NumPhases);
+					std::pair<size_t, size_t> score{ 0, 0 };
+					for (size_t j = 0; j < count; ++j) {
+						scalar_t low = std::floor((bounds[j].min[i] - phase) / spacing[i]);
+						scalar_t high = std::floor((bounds[j].max[i] - phase) / spacing[i]);
+						size_t span = static_cast<size_t>(high - low);
+						score.first += span > 1;
+						score.second += span;
+					}
+					if (score < best) {
+						best = score;
+						origin[i] = phase;
+					}
+				}
+			}
+			return origin;
+		}
+
+		// Grid with the spacing of suggestSpacing and the phase of suggestOrigin.
+		static grid_t suggestGrid(const bbox_t* const bounds, size_t count, scalar_t fraction = scalar_t(0.9)) {
+			vec_t spacing = suggestSpacing(bounds, count, fraction);
+			return grid_t(spacing, suggestOrigin(bounds, count, spacing));
+		}
+
+		const grid_t& getGrid() const {
+			return grid;
+		}
+		Encapsulation getPolicy() const noexcept {
+			return policy;
+		}
+
+		void clear() {
+			table.clear();
+			partial.clear();
+			nleftovers = 0;
+		}
+
+		// Number of partitions holding at least one object, including the ones holding leftovers.
+		size_t numPartitions() const {
+			return table.numCells() + partial.numCells();
+		}
+		// Number of objects that didn't fit into a single partition, always zero for partial encapsulation.
+		size_t numLeftovers() const noexcept {
+			return nleftovers;
+		}
+
+		void build(const bbox_t* const bounds, size_t count) {
+			clear();
+
+			lows.resize(count);
+			highs.resize(count);
+			grid.calcBounds(bounds, count, lows.data(), highs.data());
+
+			int64_t totalEntries = 0, partialEntries = 0;
+			for (size_t i = 0; i < count; ++i) {
+				const ivec_t& c0 = lows[i];
+				const ivec_t& c1 = highs[i];
+				if (isContained(c0, c1)) {
+					table.count(c0, totalEntries);
+				}
+				else {
+					partial.count(c0 - ivec_t(1), c1, partialEntries);
+					nleftovers += policy == Encapsulation::Total;
+				}
+			}
+
+			table.prepareCellEntries(totalEntries);
+			partial.prepareCellEntries(partialEntries);
+
+			for (size_t i = 0; i < count; ++i) {
+				const ivec_t& c0 = lows[i];
+				const ivec_t& c1 = highs[i];
+				if (isContained(c0, c1)) {
+					table.insert(static_cast<index_t>(i), c0);
+				}
+				else {
+					partial.insert(static_cast<index_t>(i), c0 - ivec_t(1), c1);
+				}
+			}
+		}
+
+		// Find all the overlapping pairs among the bounds the table was built from.
+		// Each group in the list starts with the id of a box, followed by the ids of the boxes it overlaps.
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapList& list) const {
+			list.clear();
+
+			detail::OverlapListSink sink{ list };
+			findOverlapsImpl(ids, bounds, count, sink);
+		}
+		// Same as above, but writes each pair directly into a flat list.
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, PairList<index_t>& pairs) const {
+			pairs.clear();
+
+			detail::PairListSink<index_t> sink{ pairs, 0 };
+			findOverlapsImpl(ids, bounds, count, sink);
+		}
+		// Same as above, but writes a symmetric adjacency indexed by the ids.
+		void findOverlaps(const index_t* const ids, const bbox_t* const bounds, size_t count, OverlapCSR<index_t>& csr) const {
+			auto& pairs = csr.scratch();
+			findOverlaps(ids, bounds, count, pairs);
+			csr.assign(pairs, detail::vertexCount(ids, count));
+		}
+
+	private:
+		// True if the object is stored with total encapsulation, in the single partition starting at c0.
+		bool isContained(const ivec_t& c0, const ivec_t& c1) const noexcept {
+			if (policy == Encapsulation::Partial) {
+				return false;
+			}
+			return glm::all(glm::lessThanEqual(c1 - c0, ivec_t(1)));
+		}
+
+		template<typename Sink>
+		void findOverlapsImpl(const index_t* const ids, const bbox_t* const bounds, size_t count, Sink& sink) const {
+			/*
+			Totally encapsulated objects are in exactly one partition. Two of them can only overlap if their partitions overlap,
+			so they search the neighboring partitions, skipping higher indices so each pair is only visited once.
+
+			Partially encapsulated objects (all of them for the partial policy, the leftovers for the total policy) are in every
+			partition they touch. Both objects of an overlapping pair touch the partition starting at the cell of the max of the two mins,
+			so only that partition reports the pair.
+
+			Leftovers never search the totally encapsulated objects, the contained objects search the leftovers instead.
+			*/
+			struct Candidate {
+				index_t cid;
+				// Partition the candidate was found in, only checked when the candidate is partially encapsulated.
+				ivec_t loc;
+				bool partial;
+			};
+			BBoxBatch<Dims, scalar_t, Candidate> batch;
+
+			for (size_t bidx = 0; bidx < count; ++bidx) {
+				const bbox_t& bbox = bounds[bidx];
+				ivec_t c0 = grid.calcCell(bbox.min);
+				ivec_t c1 = grid.calcCell(bbox.max);
+				bool contained = isContained(c0, c1);
+
+				auto onOverlap = [&](const Candidate& cand) {
+					if (!cand.partial || grid.calcCell(glm::max(bbox.min, bounds[cand.cid].min)) == cand.loc) {
+						sink.add(ids[cand.cid]);
+					}
+				};
+
+				sink.begin(ids[bidx]);
+
+				if (contained) {
+					applyAllCells(c0 - ivec_t(1), c0 + ivec_t(1), [&](const ivec_t& loc) {
+						for (index_t cid : table.find(loc)) {
+							if (cid >= static_cast<index_t>(bidx)) {
+								continue;
+							}
+							batch.add(bbox, bounds[cid], Candidate{ cid, loc, false }, onOverlap);
+						}
+					});
+				}
+
+				if (partial.numCells() != 0) {
+					applyAllCells(c0 - ivec_t(1), c1, [&](const ivec_t& loc) {
+						for (index_t cid : partial.find(loc)) {
+							// Partially encapsulated objects only have to skip the higher indices among themselves.
+							if (!contained && cid >= static_cast<index_t>(bidx)) {
+								continue;
+							}
+							batch.add(bbox, bounds[cid], Candidate{ cid, loc, true }, onOverlap);
+						}
+					});
+				}
+
+				batch.flush(bbox, onOverlap);
+				sink.end();
+			}
+		}
+
+		grid_t grid;
+		Encapsulation policy;
+
+		// Totally encapsulated objects, keyed by their single partition.
+		subtable_t table;
+		// Partially encapsulated objects (everything, or just the leftovers), keyed by every partition they touch.
+		subtable_t partial;
+		size_t nleftovers = 0;
+		// Cells of the last build, kept so the memory is reused.
+		std::vector<ivec_t> lows, highs;
+	};
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <cinttypes>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <glm/glm.hpp>
+#include <pbd/common/BBox.hpp>
+#include <pbd/hashing/Executor.hpp>
+
+namespace pbd {
+	// Narrow phase tests for the overlap queries of the tables.
+	// Called as predicate(a, b) with the positions of the two boxes in the bounds array (not their ids),
+	// only for pairs whose boxes overlap. Returning false drops the pair before it reaches the output.
+	// Any callable taking two indices works, the presets below read the shapes from user arrays laid out like the bounds.
+
+	// Keeps every pair, the box test has already been done.
+	struct BoxOverlap {
+		template<typename index_t>
+		constexpr bool operator()(index_t, index_t) const noexcept {
+			return true;
+		}
+	};
+
+	// Spheres with a radius per object, or the same radius for all of them when radii is null.
+	template<glm::length_t L, typename scalar_t>
+	struct SphereOverlap {
+		using vec_t = glm::vec<L, scalar_t>;
+
+		const vec_t* centers = nullptr;
+		const scalar_t* radii = nullptr;
+		scalar_t radius = scalar_t(0);
+
+		scalar_t radiusOf(size_t i) const noexcept {
+			return radii ? radii[i] : radius;
+		}
+		// The box around sphere i, used by the tables that build straight from the spheres.
+		BBox<L, scalar_t> bounds(size_t i) const noexcept {
+			scalar_t r = radiusOf(i);
+			return BBox<L, scalar_t>(centers[i] - r, centers[i] + r);
+		}
+
+		template<typename index_t>
+		bool operator()(index_t a, index_t b) const noexcept {
+			vec_t d = centers[a] - centers[b];
+			scalar_t r = radiusOf(a) + radiusOf(b);
+			return glm::dot(d, d) <= r * r;
+		}
+	};
+
+	// Capsules, the segment from first[i] to second[i] swept by a sphere.
+	template<glm::length_t L, typename scalar_t>
+	struct CapsuleOverlap {
+		using vec_t = glm::vec<L, scalar_t>;
+
+		const vec_t* first = nullptr;
+		const vec_t* second = nullptr;
+		const scalar_t* radii = nullptr;
+		scalar_t radius = scalar_t(0);
+
+		scalar_t radiusOf(size_t i) const noexcept {
+			return radii ? radii[i] : radius;
+		}
+
+		template<typename index_t>
+		bool operator()(index_t a, index_t b) const noexcept {
+			scalar_t r = radiusOf(a) + radiusOf(b);
+			return segmentDistance2(first[a], second[a], first[b], second[b]) <= r * r;
+		}
+
+		// Squared distance between the segments [p0, p1] and [q0, q1], from the closest points on both.
+		static scalar_t segmentDistance2(const vec_t& p0, const vec_t& p1, const vec_t& q0, const vec_t& q1) noexcept {
+			constexpr scalar_t eps = std::numeric_limits<scalar_t>::epsilon();
+			vec_t d1 = p1 - p0, d2 = q1 - q0, r = p0 - q0;
+			scalar_t a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+
+			scalar_t s, t;
+			if (a <= eps && e <= eps) {
+				s = t = scalar_t(0);
+			}
+			else if (a <= eps) {
+				s = scalar_t(0);
+				t = std::clamp(f / e, scalar_t(0), scalar_t(1));
+			}
+			else {
+				scalar_t c = glm::dot(d1, r);
+				if (e <= eps) {
+					t = scalar_t(0);
+					s = std::clamp(-c / a, scalar_t(0), scalar_t(1));
+				}
+				else {
+					scalar_t b = glm::dot(d1, d2);
+					scalar_t denom = a * e - b * b;
+					// Parallel segments pick any s, zero works.
+					s = denom > eps ? std::clamp((b * f - c * e) / denom, scalar_t(0), scalar_t(1)) : scalar_t(0);
+					t = (b * s + f) / e;
+					if (t < scalar_t(0)) {
+						t = scalar_t(0);
+						s = std::clamp(-c / a, scalar_t(0), scalar_t(1));
+					}
+					else if (t > scalar_t(1)) {
+						t = scalar_t(1);
+						s = std::clamp((b - c) / a, scalar_t(0), scalar_t(1));
+					}
+				}
+			}
+
+			vec_t d = (p0 + d1 * s) - (q0 + d2 * t);
+			return glm::dot(d, d);
+		}
+	};
+
+	namespace detail {
+		// Both tests have to pass, the second one only runs when the first does.
+		template<typename First, typename Second>
+		struct BothOverlap {
+			const First& first;
+			const Second& second;
+
+			template<typename index_t>
+			bool operator()(index_t a, index_t b) const {
+				return first(a, b) && second(a, b);
+			}
+		};
+
+		// Used to tell the predicate overloads apart from the executor ones.
+		template<typename T, typename index_t>
+		using enable_if_predicate_t = std::enable_if_t<std::is_invocable_r_v<bool, const std::decay_t<T>&, index_t, index_t> && !IsExecutor<std::decay_t<T>>::value, int>;
+	}
+}
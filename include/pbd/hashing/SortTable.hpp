@@ -1,13 +1,16 @@
 #pragma once
 #include <pbd/hashing/Grid.hpp>
-#include <pbd/hashing/BBox.hpp>
+#include <pbd/common/BBox.hpp>
+#include <pbd/hashing/BBoxBatch.hpp>
+#include <pbd/hashing/OverlapList.hpp>
+#include <pbd/hashing/OverlapSink.hpp>
 #include <cinttypes>
 #include <vector>
-#include <array>
+#include <algorithm>
 
 namespace pbd {
 	/*
-	Table of my own design, sorts along all the axes of the vectors,
+	Table of my own design, sorts along the first axis of the vectors,
 	Then generates a list of overlaps.
 	
 	This table is meant as a means to implement a broad phase pass of a collision engine.
@@ -27,44 +30,79 @@ namespace pbd {
 
 		static_assert(Dims > 1 && Dims < 4, "pbd::SortTable expects 2 or 3 dimensional elements!");
 
+		void clear() {
+			ids.clear();
+			bounds.clear();
+			sorted.clear();
+		}
+
+		size_t size() const noexcept {
+			return bounds.size();
+		}
+
 		void build(const index_t* const _ids, const bbox_t* const _bounds, size_t count) {
 			// Copy over all the bounds.
 			// Sort them by their minimum.
 			
-			// Once the axes have been sorted begin the process of generating the list of overlaps.
+			// Once the axis has been sorted begin the process of generating the list of overlaps.
 			// Every overlap is a pairing of objects, in order to prevent generating duplicate pairings only generate the pairing
-			//  where the first id is less than the second id.
+			//  with the objects that come after the first one in the sorted order.
 			// In order to reduce the total data used to define those pairings,
-			//  put the first id, then follow it by all the other ids it overlaps with (first id < second id)
-
-			/*
-			First test:
-				Add an index to be sorted for the min and max of each bbox.
-				
-			*/
-			const bbox_t* bit = _bounds;
-			const bbox_t* const bend = _bounds + count;
-			const index_t* idit = _ids;
-			const index_t* const idend = _ids + count;
-
-			for (int i = 0; i < Dims; ++i) {
-				auto & sdim = sdims[i];
-				sdim.clear();
-				sdim.reserve(count * 2);
-
-				for (bit = _bounds, idit = _ids; bit != bend; ++bit) {
-					sdim.push_back(Element(*idit, bit->min[i]));
-					sdim.push_back(Element(*idit, bit->max[i]));
-				}
-			}
+			//  put the first id, then follow it by all the other ids it overlaps with.
+			ids.assign(_ids, _ids + count);
+			bounds.assign(_bounds, _bounds + count);
 
-			for (int i = 0; i < Dims; ++i) {
-				std::sort(sdims[i].begin(), sdims[i].end());
+			sorted.clear();
+			sorted.reserve(count);
+			for (size_t i = 0; i < count; ++i) {
+				sorted.push_back(Element{ static_cast<index_t>(i), bounds[i].min[0] });
 			}
+
+			std::sort(sorted.begin(), sorted.end());
+		}
+
+		// Find all the overlapping pairs among the bounds the table was built from.
+		void findOverlaps(OverlapList& list) const {
+			list.clear();
+
+			detail::OverlapListSink sink{ list };
+			findOverlapsImpl(sink);
+		}
+		// Same as above, but writes each pair directly into a flat list.
+		// The list is cleared first, its capacity is kept so it can be reused from frame to frame.
+		void findOverlaps(PairList<index_t>& pairs) const {
+			pairs.clear();
+
+			detail::PairListSink<index_t> sink{ pairs, 0 };
+			findOverlapsImpl(sink);
+		}
+		// Same as above, but writes a symmetric adjacency indexed by the ids.
+		void findOverlaps(OverlapCSR<index_t>& csr) const {
+			auto& pairs = csr.scratch();
+			findOverlaps(pairs);
+			csr.assign(pairs, detail::vertexCount(ids.data(), ids.size()));
 		}
 
 	private:
-		std::vector<bbox_t> bounds;
+		template<typename Sink>
+		void findOverlapsImpl(Sink& sink) const {
+			// Sweep along the sorted axis, everything that starts before the current box ends is a candidate.
+			BBoxBatch<Dims, scalar_t, index_t> batch;
+
+			for (auto it = sorted.begin(), last = sorted.end(); it != last; ++it) {
+				const bbox_t& bbox = bounds[it->id];
+				auto onOverlap = [&](index_t cid) {
+					sink.add(ids[cid]);
+				};
+
+				sink.begin(ids[it->id]);
+				for (auto cand = it + 1; cand != last && cand->pos <= bbox.max[0]; ++cand) {
+					batch.add(bbox, bounds[cand->id], cand->id, onOverlap);
+				}
+				batch.flush(bbox, onOverlap);
+				sink.end();
+			}
+		}
 
 		struct Element {
 			index_t id;
@@ -74,8 +112,9 @@ namespace pbd {
 				return pos < other.pos;
 			}
 		};
-		std::array<std::vector<Element>, Dims> sdims;
-
 
+		std::vector<index_t> ids;
+		std::vector<bbox_t> bounds;
+		std::vector<Element> sorted;
 	};
-}
\ No newline at end of file
+}
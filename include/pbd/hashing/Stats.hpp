@@ -0,0 +1,89 @@
+#pragma once
+#include <cinttypes>
+#include <vector>
+#include <algorithm>
+
+// Define PBD_HASHING_STATS as 1 before including any table to count the work done by findOverlaps.
+// When it is 0 the counting is compiled out, and the query part of the stats stays zero.
+// The tables hold their counters either way, so translation units built with different settings still agree on the layout.
+#ifndef PBD_HASHING_STATS
+#define PBD_HASHING_STATS 0
+#endif
+
+#if PBD_HASHING_STATS
+#define PBD_HASHING_STAT(expr) expr
+#else
+#define PBD_HASHING_STAT(expr) ((void)0)
+#endif
+
+namespace pbd {
+	// Work done by the last call to findOverlaps.
+	struct QueryStats {
+		// Boxes handed to the overlap test.
+		uint64_t candidates = 0;
+		// Pairs written to the output.
+		uint64_t accepted = 0;
+		// Boxes skipped before the overlap test because another shared cell reports the pair.
+		uint64_t duplicates = 0;
+		// Pairs whose boxes overlap but were dropped by the narrow phase predicate.
+		uint64_t rejected = 0;
+
+		void reset() noexcept {
+			*this = QueryStats{};
+		}
+
+		// Combine the counters of queries run in parts.
+		QueryStats& operator+=(const QueryStats& other) noexcept {
+			candidates += other.candidates;
+			accepted += other.accepted;
+			duplicates += other.duplicates;
+			rejected += other.rejected;
+			return *this;
+		}
+	};
+
+	struct TierStats {
+		size_t objects = 0;
+		size_t cells = 0;
+		size_t entries = 0;
+	};
+
+	// Snapshot of the layout of a table after build, computed on demand by the stats() functions.
+	struct TableStats {
+		size_t cells = 0;
+		// Number of ids stored, an object spanning several cells is counted once per cell.
+		size_t entries = 0;
+		double meanEntries = 0.0;
+		size_t maxEntries = 0;
+
+		// Cell occupancy, histogram[k] is the number of cells holding [2^k, 2^(k+1)) ids.
+		std::vector<size_t> histogram;
+
+		// Only filled in by the HTable, one per tier.
+		std::vector<TierStats> tiers;
+
+		double loadFactor = 0.0;
+		// Memory held by the hash map and the entry list, including unused capacity.
+		size_t bytes = 0;
+
+		QueryStats queries;
+
+		void addCell(size_t count) {
+			++cells;
+			entries += count;
+			maxEntries = std::max(maxEntries, count);
+
+			size_t bucket = 0;
+			while ((count >> (bucket + 1)) != 0) {
+				++bucket;
+			}
+			if (histogram.size() <= bucket) {
+				histogram.resize(bucket + 1, 0);
+			}
+			++histogram[bucket];
+		}
+		void finish() noexcept {
+			meanEntries = cells == 0 ? 0.0 : static_cast<double>(entries) / static_cast<double>(cells);
+		}
+	};
+}
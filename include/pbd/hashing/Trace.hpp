@@ -0,0 +1,225 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Define PBD_HASHING_TRACE as 1 before including any table to time the build and query phases.
+// When it is 0 the scopes compile to nothing.
+#ifndef PBD_HASHING_TRACE
+#define PBD_HASHING_TRACE 0
+#endif
+
+#define PBD_HASHING_TRACE_CONCAT_IMPL(a, b) a##b
+#define PBD_HASHING_TRACE_CONCAT(a, b) PBD_HASHING_TRACE_CONCAT_IMPL(a, b)
+
+#if PBD_HASHING_TRACE
+#define PBD_HASHING_TRACE_SCOPE(name) ::pbd::trace::Scope PBD_HASHING_TRACE_CONCAT(pbd_trace_scope_, __LINE__)(name)
+#else
+#define PBD_HASHING_TRACE_SCOPE(name) ((void)0)
+#endif
+
+namespace pbd::trace {
+	using clock_type = std::chrono::steady_clock;
+
+	struct Event {
+		// Must be a string literal, only the pointer is stored.
+		const char* name;
+		// Nanoseconds since the buffer was created.
+		int64_t start;
+		int64_t duration;
+		uint32_t thread;
+	};
+
+	// Small sequential id for the calling thread, in the order the threads first record an event.
+	inline uint32_t threadId() {
+		static std::atomic<uint32_t> next{ 0 };
+		thread_local uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+		return id;
+	}
+
+	// In memory list of the completed scopes.
+	// Every thread appends to its own list, so recording only takes a lock nobody else holds while the scopes run.
+	// The lists are merged when the events are read.
+	class Buffer {
+	public:
+		// Events kept per thread by default, the later ones are counted as dropped.
+		static constexpr size_t defaultCapacity = size_t(1) << 16;
+
+		Buffer()
+			: origin(clock_type::now())
+			, id(nextId().fetch_add(1, std::memory_order_relaxed))
+		{}
+
+		Buffer(const Buffer&) = delete;
+		Buffer& operator=(const Buffer&) = delete;
+
+		// The buffer the trace scopes write to.
+		static Buffer& global() {
+			static Buffer buffer;
+			return buffer;
+		}
+
+		int64_t now() const {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - origin).count();
+		}
+
+		void record(const Event& event) {
+			Local& list = local();
+			std::lock_guard<std::mutex> lock(list.mutex);
+			if (list.events.size() < capacity.load(std::memory_order_relaxed)) {
+				list.events.push_back(event);
+			}
+			else {
+				++list.dropped;
+			}
+		}
+
+		void clear() {
+			std::lock_guard<std::mutex> lock(mutex);
+			for (const std::unique_ptr<Local>& list : locals) {
+				if (list) {
+					std::lock_guard<std::mutex> listLock(list->mutex);
+					list->events.clear();
+					list->dropped = 0;
+				}
+			}
+		}
+
+		// Limit on the events kept for each thread.
+		void setCapacity(size_t count) {
+			capacity.store(count, std::memory_order_relaxed);
+		}
+		size_t getCapacity() const {
+			return capacity.load(std::memory_order_relaxed);
+		}
+
+		// Number of events that didn't fit since the last clear.
+		size_t dropped() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			size_t count = 0;
+			for (const std::unique_ptr<Local>& list : locals) {
+				if (list) {
+					std::lock_guard<std::mutex> listLock(list->mutex);
+					count += list->dropped;
+				}
+			}
+			return count;
+		}
+
+		// Copy of the events recorded so far, in the order the scopes closed.
+		std::vector<Event> events() const {
+			std::vector<Event> result;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (const std::unique_ptr<Local>& list : locals) {
+					if (list) {
+						std::lock_guard<std::mutex> listLock(list->mutex);
+						result.insert(result.end(), list->events.begin(), list->events.end());
+					}
+				}
+			}
+			// Stable so the events of one thread keep their order when the clock doesn't move between them.
+			std::stable_sort(result.begin(), result.end(), [](const Event& a, const Event& b) {
+				return a.start + a.duration < b.start + b.duration;
+			});
+			return result;
+		}
+
+		// Write the events in the chrome trace format, loadable in chrome://tracing or Perfetto.
+		void writeChromeTrace(std::ostream& out) const {
+			std::vector<Event> list = events();
+
+			out << "{\"traceEvents\":[";
+			for (size_t i = 0; i < list.size(); ++i) {
+				const Event& event = list[i];
+				if (i != 0) {
+					out << ',';
+				}
+				// Complete events, timestamps in microseconds.
+				out << "\n{\"name\":\"" << event.name << "\",\"cat\":\"pbd\",\"ph\":\"X\""
+					<< ",\"ts\":" << event.start / 1000 << '.' << fraction(event.start)
+					<< ",\"dur\":" << event.duration / 1000 << '.' << fraction(event.duration)
+					<< ",\"pid\":0,\"tid\":" << event.thread << '}';
+			}
+			out << "\n]}\n";
+		}
+	private:
+		// Three digit fractional part of a nanosecond count converted to microseconds.
+		struct Fraction {
+			int64_t value;
+
+			friend std::ostream& operator<<(std::ostream& out, const Fraction& frac) {
+				int64_t v = frac.value;
+				return out << char('0' + v / 100) << char('0' + (v / 10) % 10) << char('0' + v % 10);
+			}
+		};
+		static Fraction fraction(int64_t ns) noexcept {
+			return Fraction{ ns % 1000 };
+		}
+
+		// Events of one thread, the lock is only contended while the events are read or cleared.
+		struct Local {
+			std::mutex mutex;
+			std::vector<Event> events;
+			size_t dropped = 0;
+		};
+
+		static std::atomic<uint64_t>& nextId() {
+			static std::atomic<uint64_t> next{ 1 };
+			return next;
+		}
+
+		// List of the calling thread, created on its first event.
+		// The threads remember the last buffer they wrote to, so the shared lock is only taken once per thread and buffer.
+		Local& local() {
+			thread_local uint64_t cachedId = 0;
+			thread_local Local* cached = nullptr;
+			if (cachedId == id) {
+				return *cached;
+			}
+
+			uint32_t thread = threadId();
+			std::lock_guard<std::mutex> lock(mutex);
+			if (locals.size() <= thread) {
+				locals.resize(thread + 1);
+			}
+			if (!locals[thread]) {
+				locals[thread] = std::make_unique<Local>();
+			}
+			cachedId = id;
+			cached = locals[thread].get();
+			return *cached;
+		}
+
+		clock_type::time_point origin;
+		uint64_t id;
+		std::atomic<size_t> capacity{ defaultCapacity };
+		// Guards the list of threads, indexed by threadId.
+		mutable std::mutex mutex;
+		std::vector<std::unique_ptr<Local>> locals;
+	};
+
+	// Records the time between its construction and destruction into the global buffer.
+	class Scope {
+	public:
+		Scope(const char* _name)
+			: name(_name)
+			, start(Buffer::global().now())
+		{}
+		~Scope() {
+			Buffer& buffer = Buffer::global();
+			buffer.record(Event{ name, start, buffer.now() - start, threadId() });
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	private:
+		const char* name;
+		int64_t start;
+	};
+}
@@ -1,9 +1,16 @@
 #pragma once
 #include <cassert>
+#include <cinttypes>
+#include <vector>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <glm/common.hpp>
 #include <glm/gtx/hash.hpp>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace pbd {
 	template<glm::length_t L, typename index_t>
 	static index_t hash(const glm::vec<L, index_t>& vec) {
@@ -15,6 +22,38 @@ namespace pbd {
 		return result;
 	}
 
+	// Checkerboard batch of a cell, one bit per axis from the parity of its coordinate.
+	// Two different cells with the same parity never touch, not even diagonally.
+	template<glm::length_t L, typename index_t>
+	size_t parityOf(const glm::vec<L, index_t>& cell) noexcept {
+		size_t parity = 0;
+		for (glm::length_t i = 0; i < L; ++i) {
+			parity |= static_cast<size_t>(cell[i] & 1) << i;
+		}
+		return parity;
+	}
+
+	// Index of the lowest set bit, val must not be zero.
+	inline int countTrailingZeros(uint32_t val) noexcept {
+		assert(val != 0);
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, val);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctz(val);
+#endif
+	}
+
+	// Call func with the index of every set bit in the mask, lowest first.
+	template<typename Func>
+	void forEachBit(uint32_t mask, Func&& func) {
+		while (mask != 0) {
+			func(countTrailingZeros(mask));
+			mask &= mask - 1;
+		}
+	}
+
 	template<glm::length_t L, typename index_t, typename Func>
 	void applyAllCells(const glm::vec<L, index_t>& b0, const glm::vec<L, index_t>& b1, Func&& func) {
 		glm::vec<L, index_t> vec = b0;
@@ -0,0 +1,92 @@
+#include <pbd/common/BBox.hpp>
+#include <pbd/hashing/AsyncTable.hpp>
+#include <pbd/hashing/DVTable.hpp>
+#include <pbd/hashing/HTable.hpp>
+#include <pbd/hashing/DenseTable.hpp>
+#include <pbd/hashing/Executor.hpp>
+
+#include <Scenes.hpp>
+
+#include <catch2/catch_all.hpp>
+
+using namespace pbd;
+
+using index_t = int32_t;
+using bbox_t = BBox<3, float>;
+using vec_t = glm::vec3;
+using scene_t = scenes::Scene<3, float, index_t>;
+using pair_set_t = scenes::PairSet<index_t>;
+
+namespace {
+	template<typename Table>
+	void checkFrames(AsyncTable<Table>& async) {
+		bbox_t domain(vec_t(-8.f), vec_t(8.f));
+		scenes::MovingScene<3, float> moving(scenes::uniformPoints<3, float>(300, domain, 0.5f, 11), domain, 3.f, 0.8f, 12);
+		const scene_t& scene = moving.scene();
+
+		REQUIRE_FALSE(async.swap());
+		async.build(scene.bounds.data(), scene.size());
+		REQUIRE(async.size() == scene.size());
+
+		PairList<index_t> pairs;
+		for (int frame = 0; frame < 4; ++frame) {
+			pair_set_t current = scenes::bruteForce(scene.bounds, scene.ids);
+
+			// Start the next frame, then mess up the input while the build runs, it has to work on its own copy.
+			moving.step(0.1f);
+			std::vector<bbox_t> next = scene.bounds;
+			async.startBuild(next.data(), next.size());
+			pair_set_t expected = scenes::bruteForce(next, scene.ids);
+			std::fill(next.begin(), next.end(), bbox_t(vec_t(0.f), vec_t(1.f)));
+
+			// The current table still answers for the previous frame.
+			async.findOverlaps(scene.ids.data(), pairs);
+			REQUIRE(scenes::collect(pairs) == current);
+
+			REQUIRE(async.swap());
+			REQUIRE_FALSE(async.isBuilding());
+			REQUIRE_FALSE(async.isReady());
+			async.findOverlaps(scene.ids.data(), pairs);
+			REQUIRE(scenes::collect(pairs) == expected);
+		}
+
+		// A finished build that wasn't swapped in is replaced by the next one.
+		moving.step(0.1f);
+		async.startBuild(scene.bounds.data(), scene.size());
+		async.wait();
+		REQUIRE(async.isReady());
+		moving.step(0.1f);
+		async.startBuild(scene.bounds.data(), scene.size());
+		REQUIRE(async.swap());
+		async.findOverlaps(scene.ids.data(), pairs, SerialExecutor{});
+		REQUIRE(scenes::collect(pairs) == scenes::bruteForce(scene.bounds, scene.ids));
+	}
+}
+
+TEST_CASE("async table") {
+	SECTION("DVTable") {
+		AsyncTable<DVTable<float, index_t, 3>> async;
+		async.configure([](auto& table) {
+			table.initialize(vec_t(1.f));
+		});
+		checkFrames(async);
+	}
+	SECTION("HTable") {
+		AsyncTable<HTable<float, index_t, 3>> async(HTable<float, index_t, 3>(vec_t(0.5f), 6));
+		checkFrames(async);
+	}
+	SECTION("DenseTable") {
+		AsyncTable<DenseTable<float, index_t, 3>> async;
+		async.configure([](auto& table) {
+			table.initialize(vec_t(1.f), bbox_t(vec_t(-8.f), vec_t(8.f)));
+		});
+		checkFrames(async);
+	}
+	SECTION("Destroyed while building") {
+		bbox_t domain(vec_t(-8.f), vec_t(8.f));
+		scene_t scene = scenes::uniformPoints<3, float>(2000, domain, 0.5f, 13);
+
+		AsyncTable<HTable<float, index_t, 3>> async(HTable<float, index_t, 3>(vec_t(1.f), 4));
+		async.startBuild(scene.bounds.data(), scene.size());
+	}
+}
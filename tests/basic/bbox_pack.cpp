@@ -0,0 +1,62 @@
+#include <array>
+#include <random>
+
+#include <pbd/common/BBox.hpp>
+#include <pbd/common/BBoxPack.hpp>
+
+#include <catch2/catch_all.hpp>
+
+using namespace pbd;
+
+template<glm::length_t L, typename scalar_t>
+static void testPack() {
+	using bbox_t = BBox<L, scalar_t>;
+	using vec_t = typename bbox_t::vec_t;
+	using pack_t = BBoxPack<L, scalar_t>;
+
+	std::mt19937 gen(1234);
+	std::uniform_real_distribution<scalar_t> pos(-4, 4), size(0, 3);
+
+	auto randomBox = [&]() {
+		vec_t min, ext;
+		for (glm::length_t i = 0; i < L; ++i) {
+			min[i] = pos(gen);
+			ext[i] = size(gen);
+		}
+		return bbox_t(min, min + ext);
+	};
+
+	pack_t pack;
+	std::array<bbox_t, pack_t::Width> others;
+	for (int round = 0; round < 200; ++round) {
+		bbox_t box = randomBox();
+		int count = 1 + round % pack_t::Width;
+		for (int j = 0; j < count; ++j) {
+			others[j] = randomBox();
+			pack.set(j, others[j]);
+		}
+
+		// The kernel never sets bits past the width of the pack, whatever the stale lanes hold.
+		uint32_t raw = overlapMask(box, pack);
+		REQUIRE((raw & ~pack_t::lanes(pack_t::Width)) == 0);
+
+		uint32_t mask = raw & pack_t::lanes(count);
+		for (int j = 0; j < count; ++j) {
+			REQUIRE(bool(mask & (uint32_t(1) << j)) == box.overlaps(others[j]));
+		}
+	}
+
+	// Touching boxes count as overlapping, same as BBox::overlaps.
+	bbox_t box(vec_t(0), vec_t(1));
+	pack.set(0, bbox_t(vec_t(1), vec_t(2)));
+	pack.set(1, bbox_t(vec_t(-2), vec_t(0)));
+	pack.set(2, bbox_t(vec_t(1.5), vec_t(2)));
+	REQUIRE((overlapMask(box, pack) & pack_t::lanes(3)) == 0b011);
+}
+
+TEST_CASE("BBoxPack", "[common]") {
+	testPack<2, float>();
+	testPack<3, float>();
+	testPack<2, double>();
+	testPack<3, double>();
+}
@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <random>
+
+#include <pbd/hashing/Coloring.hpp>
+
+#include <catch2/catch_all.hpp>
+
+using namespace pbd;
+
+using index_t = int32_t;
+
+static void requireValid(const ConstraintColoring<index_t>& coloring, const PairList<index_t>& pairs, size_t nbodies) {
+	std::vector<index_t> seen(pairs.size(), 0);
+	std::vector<size_t> owner(nbodies, 0);
+
+	for (size_t color = 0; color < coloring.numColors(); ++color) {
+		for (index_t c : coloring[color]) {
+			REQUIRE(coloring.colorOf(c) == static_cast<index_t>(color));
+			++seen[c];
+
+			// No two constraints of a batch may touch the same body, owner holds color+1 of the last constraint touching the body.
+			REQUIRE(owner[pairs[c].first] != color + 1);
+			REQUIRE(owner[pairs[c].second] != color + 1);
+			owner[pairs[c].first] = color + 1;
+			owner[pairs[c].second] = color + 1;
+		}
+	}
+	for (index_t count : seen) {
+		REQUIRE(count == 1);
+	}
+}
+
+TEST_CASE("ConstraintColoring") {
+	const size_t nbodies = 500;
+	std::mt19937 gen(5);
+	std::uniform_int_distribution<index_t> pick(0, nbodies - 1);
+
+	PairList<index_t> pairs;
+	while (pairs.size() < 1500) {
+		index_t a = pick(gen), b = pick(gen);
+		if (a != b) {
+			pairs.emplace_back(a, b);
+		}
+	}
+
+	ConstraintColoring<index_t> coloring;
+	coloring.build(pairs, nbodies);
+	REQUIRE(coloring.size() == pairs.size());
+	REQUIRE(coloring.numColors() > 1);
+	requireValid(coloring, pairs, nbodies);
+
+	SECTION("Threads give the same result") {
+		ConstraintColoring<index_t> threaded;
+		threaded.build(pairs, nbodies, 4);
+		requireValid(threaded, pairs, nbodies);
+		for (size_t c = 0; c < pairs.size(); ++c) {
+			REQUIRE(threaded.colorOf(c) == coloring.colorOf(c));
+		}
+	}
+
+	SECTION("Unbalanced") {
+		ConstraintColoring<index_t> unbalanced;
+		unbalanced.setBalanced(false);
+		unbalanced.build(pairs, nbodies);
+		requireValid(unbalanced, pairs, nbodies);
+
+		auto spread = [](const ConstraintColoring<index_t>& value) {
+			size_t smallest = value.size(), largest = 0;
+			for (size_t color = 0; color < value.numColors(); ++color) {
+				smallest = std::min(smallest, value[color].size());
+				largest = std::max(largest, value[color].size());
+			}
+			return largest - smallest;
+		};
+		REQUIRE(spread(coloring) <= spread(unbalanced));
+	}
+
+	SECTION("Recolor keeps persisting colors") {
+		std::vector<index_t> previous;
+		for (size_t c = 0; c < pairs.size(); ++c) {
+			previous.push_back(coloring.colorOf(c));
+		}
+
+		// Drop some constraints, add a few new ones, and shuffle the order.
+		PairList<index_t> next(pairs.begin() + 100, pairs.end());
+		std::vector<index_t> nextPrevious(previous.begin() + 100, previous.end());
+		for (int i = 0; i < 20; ++i) {
+			index_t a = pick(gen), b = pick(gen);
+			if (a != b) {
+				next.emplace_back(b, a);
+				nextPrevious.push_back(-1);
+			}
+		}
+		// The history is looked up by pair, so the surviving constraints keep their colors at any position.
+		std::vector<size_t> order(next.size());
+		std::iota(order.begin(), order.end(), size_t(0));
+		std::shuffle(order.begin(), order.end(), gen);
+		PairList<index_t> shuffled;
+		std::vector<index_t> shuffledPrevious;
+		for (size_t c : order) {
+			shuffled.push_back(next[c]);
+			shuffledPrevious.push_back(nextPrevious[c]);
+		}
+		next.swap(shuffled);
+		nextPrevious.swap(shuffledPrevious);
+
+		coloring.recolor(next, nbodies);
+		requireValid(coloring, next, nbodies);
+
+		size_t kept = 0;
+		for (size_t c = 0; c < next.size(); ++c) {
+			kept += coloring.colorOf(c) == nextPrevious[c];
+		}
+		REQUIRE(kept > (next.size() * 3) / 4);
+	}
+
+	SECTION("From an overlap list") {
+		OverlapList list;
+		list.group();
+		list.push(0);
+		list.push(1);
+		list.push(2);
+		list.ungroup();
+		list.group();
+		list.push(3);
+		list.push(1);
+		list.ungroup();
+
+		coloring.build(list, 4);
+		REQUIRE(coloring.size() == 3);
+		// (0, 1) shares a body with both of the others, which don't share anything.
+		REQUIRE(coloring.numColors() == 2);
+		REQUIRE(coloring.colorOf(1) == coloring.colorOf(2));
+		REQUIRE(coloring.colorOf(0) != coloring.colorOf(1));
+	}
+}
@@ -0,0 +1,124 @@
+#include <set>
+
+#include <pbd/common/BBox.hpp>
+#include <pbd/hashing/DenseTable.hpp>
+#include <pbd/hashing/DVTable.hpp>
+#include <pbd/hashing/Executor.hpp>
+
+#include <Scenes.hpp>
+
+#include <catch2/catch_all.hpp>
+
+using namespace pbd;
+
+using Table = DenseTable<float, int32_t, 3>;
+using bbox_t = Table::bbox_t;
+using vec_t = Table::vec_t;
+using ivec_t = Table::ivec_t;
+using index_t = Table::index_t;
+
+TEST_CASE("dense table") {
+	Table table;
+	table.initialize(vec_t(1.f), bbox_t(vec_t(-4.f), vec_t(3.5f)));
+	REQUIRE(table.domainCells() == 8 * 8 * 8);
+
+	SECTION("Points") {
+		std::vector<vec_t> points{
+			vec_t(0.5f), vec_t(0.25f), vec_t(-3.5f),
+			// Outside of the domain
+			vec_t(10.f), vec_t(10.2f),
+		};
+		std::vector<index_t> ids{ 10, 11, 12, 13, 14 };
+		table.build(ids.data(), points.data(), points.size());
+
+		REQUIRE(table.numCells() == 3);
+		REQUIRE(table.numFallbackCells() == 1);
+
+		auto range = table.find(vec_t(0.9f));
+		REQUIRE(range.size() == 2);
+		std::set<index_t> found(range.begin(), range.end());
+		REQUIRE(found == std::set<index_t>{ 10, 11 });
+
+		REQUIRE(table.find(vec_t(-3.1f)).size() == 1);
+		REQUIRE(table.find(vec_t(-3.1f)).front() == 12);
+		REQUIRE(table.find(vec_t(10.5f)).size() == 2);
+		REQUIRE(table.find(vec_t(2.5f)).empty());
+		REQUIRE(table.find(vec_t(-20.f)).empty());
+	}
+
+	SECTION("Overlaps match the hashed table") {
+		// The scene sticks out of the domain on every side.
+		auto scene = scenes::gaussianClusters<3, float>(600, 6, bbox_t(vec_t(-5.f), vec_t(5.f)), 1.5f, 0.4f, 12);
+		table.build(scene.bounds.data(), scene.size());
+		REQUIRE(table.numFallbackCells() > 0);
+
+		DVTable<float, index_t, 3> hashed;
+		hashed.initialize(vec_t(1.f));
+		hashed.build(scene.bounds.data(), scene.size());
+		REQUIRE(table.numCells() == hashed.numCells());
+
+		PairList<index_t> dense, expected;
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), dense);
+		hashed.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), expected);
+
+		REQUIRE(scenes::collect(dense) == scenes::collect(expected));
+
+		// The parallel query gives the same list as the serial one.
+		ThreadPool pool(4);
+		PairList<index_t> parallel;
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), parallel, pool);
+		REQUIRE(parallel == dense);
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), parallel, SerialExecutor{});
+		REQUIRE(parallel == dense);
+
+		// Rebuilding reuses the arrays.
+		table.build(scene.bounds.data(), scene.size());
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), dense);
+		REQUIRE(dense.size() == expected.size());
+	}
+}
+
+TEST_CASE("dense table 64 bit entry offsets") {
+	using wide_t = DenseTable<float, int32_t, 3, Grid<int32_t, 3, float>, int64_t>;
+	using scene_t = scenes::Scene<3, float>;
+	static_assert(std::is_same_v<wide_t::offset_t, int64_t>);
+
+	bbox_t domain(vec_t(-8.f), vec_t(8.f));
+	scene_t scene = scenes::heavyTailed<3, float>(300, domain, 0.05f, 6.f, 1.1f, 10);
+	PairList<index_t> pairs;
+
+	// Half of the domain, the rest goes through the hashed fallback.
+	wide_t table;
+	table.initialize(vec_t(1.f), bbox_t(vec_t(-8.f), vec_t(0.f)));
+	table.build(scene.bounds.data(), scene.size());
+	table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+	REQUIRE(scenes::collect(pairs) == scenes::bruteForce(scene.bounds, scene.ids));
+}
+
+TEST_CASE("dense table visiting overlaps") {
+	using scene_t = scenes::Scene<3, float>;
+
+	bbox_t domain(vec_t(-8.f), vec_t(8.f));
+	scene_t scene = scenes::gaussianClusters<3, float>(400, 4, domain, 1.f, 0.2f, 14);
+
+	Table table;
+	table.initialize(vec_t(1.f), domain);
+	table.build(scene.bounds.data(), scene.size());
+
+	// Same pairs in the same order as the flat list, see the HTable test for the details.
+	PairList<index_t> pairs, visited;
+	table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+	REQUIRE(pairs.size() > 10);
+	REQUIRE(table.forEachOverlap(scene.ids.data(), scene.bounds.data(), scene.size(), [&](index_t a, index_t b) {
+		visited.emplace_back(a, b);
+	}));
+	REQUIRE(visited == pairs);
+
+	// Stop after a few pairs.
+	visited.clear();
+	REQUIRE_FALSE(table.forEachOverlap(scene.ids.data(), scene.bounds.data(), scene.size(), [&](index_t a, index_t b) {
+		visited.emplace_back(a, b);
+		return visited.size() < 5;
+	}));
+	REQUIRE(std::equal(visited.begin(), visited.end(), pairs.begin(), pairs.begin() + 5));
+}
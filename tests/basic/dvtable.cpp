@@ -6,6 +6,8 @@
 #include <pbd/hashing/Grid.hpp>
 #include <pbd/hashing/DVTable.hpp>
 
+#include <Scenes.hpp>
+
 #include <catch2/catch_all.hpp>
 
 using namespace pbd;
@@ -129,4 +131,90 @@ TEST_CASE("dvtable 2") {
 	cells = table.find(points[3]);
 	REQUIRE(cells);
 	REQUIRE(cells.size() == 1);
-}
\ No newline at end of file
+}
+
+TEST_CASE("dvtable parity batches") {
+	using vec_t = Table::vec_t;
+	using ivec_t = Table::ivec_t;
+
+	Table table;
+	table.initialize(vec_t(1.f));
+
+	// A 4x4x4 block of points centered on the origin, one per cell.
+	std::vector<vec_t> points;
+	for (int x = -2; x < 2; ++x) {
+		for (int y = -2; y < 2; ++y) {
+			for (int z = -2; z < 2; ++z) {
+				points.push_back(vec_t(x + 0.5f, y + 0.5f, z + 0.5f));
+			}
+		}
+	}
+	table.build(points.data(), points.size());
+
+	Table::parity_batches_t batches;
+	table.parityBatches(batches);
+
+	size_t total = 0;
+	for (auto& batch : batches) {
+		total += batch.size();
+		for (size_t i = 0; i < batch.size(); ++i) {
+			for (size_t j = 0; j < i; ++j) {
+				ivec_t diff = batch[i].cell() - batch[j].cell();
+				int largest = std::max(std::abs(diff.x), std::max(std::abs(diff.y), std::abs(diff.z)));
+				// Cells in a batch don't touch.
+				REQUIRE(largest >= 2);
+			}
+		}
+	}
+	REQUIRE(total == table.numCells());
+}
+
+TEST_CASE("dvtable 64 bit entry offsets") {
+	using wide_t = DVTable<float, int32_t, 3, Grid<int32_t, 3, float>, int64_t>;
+	using scene_t = scenes::Scene<3, float>;
+	using bbox_t = scene_t::bbox_t;
+	using vec_t = scene_t::vec_t;
+	using index_t = int32_t;
+	static_assert(std::is_same_v<wide_t::offset_t, int64_t>);
+
+	bbox_t domain(vec_t(-8.f), vec_t(8.f));
+	scene_t scene = scenes::heavyTailed<3, float>(300, domain, 0.05f, 6.f, 1.1f, 10);
+	PairList<index_t> pairs;
+
+	wide_t table;
+	table.initialize(vec_t(1.f));
+	table.build(scene.bounds.data(), scene.size());
+	table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+	REQUIRE(scenes::collect(pairs) == scenes::bruteForce(scene.bounds, scene.ids));
+}
+
+TEST_CASE("dvtable visiting overlaps") {
+	using scene_t = scenes::Scene<3, float>;
+	using bbox_t = scene_t::bbox_t;
+	using vec_t = scene_t::vec_t;
+	using index_t = int32_t;
+
+	bbox_t domain(vec_t(-8.f), vec_t(8.f));
+	scene_t scene = scenes::gaussianClusters<3, float>(400, 4, domain, 1.f, 0.2f, 14);
+
+	Table table;
+	table.initialize(vec_t(1.f));
+	table.build(scene.bounds.data(), scene.size());
+
+	// Same pairs in the same order as the flat list, see the HTable test for the details.
+	PairList<index_t> pairs, visited;
+	table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+	REQUIRE(pairs.size() > 10);
+	REQUIRE(table.forEachOverlap(scene.ids.data(), scene.bounds.data(), scene.size(), [&](index_t a, index_t b) {
+		visited.emplace_back(a, b);
+	}));
+	REQUIRE(visited == pairs);
+
+	// Stop after a few pairs.
+	visited.clear();
+	REQUIRE_FALSE(table.forEachOverlap(scene.ids.data(), scene.bounds.data(), scene.size(), [&](index_t a, index_t b) {
+		visited.emplace_back(a, b);
+		return visited.size() < 5;
+	}));
+	REQUIRE(std::equal(visited.begin(), visited.end(), pairs.begin(), pairs.begin() + 5));
+}
@@ -0,0 +1,209 @@
+#include <atomic>
+#include <set>
+#include <stdexcept>
+
+#include <pbd/common/BBox.hpp>
+#include <pbd/hashing/Executor.hpp>
+#include <pbd/hashing/DVTable.hpp>
+#include <pbd/hashing/HTable.hpp>
+#include <pbd/hashing/Islands.hpp>
+#include <pbd/hashing/Coloring.hpp>
+
+#include <Scenes.hpp>
+
+#include <catch2/catch_all.hpp>
+
+using namespace pbd;
+
+using index_t = int32_t;
+using bbox_t = BBox<3, float>;
+using vec_t = glm::vec3;
+
+namespace {
+	// Stand in for an external job system, runs the ranges in reverse to catch any dependence on the order.
+	struct ReverseExecutor {
+		size_t threads;
+		size_t calls = 0;
+
+		size_t concurrency() const noexcept {
+			return threads;
+		}
+
+		template<typename Func>
+		void parallel_for(size_t begin, size_t end, size_t grain, Func&& func) {
+			++calls;
+			grain = std::max<size_t>(1, grain);
+			size_t nchunks = (end - begin + grain - 1) / grain;
+			for (size_t chunk = nchunks; chunk > 0; --chunk) {
+				size_t first = begin + (chunk - 1) * grain;
+				func(first, std::min(end, first + grain));
+			}
+		}
+	};
+
+	template<typename Executor>
+	void requireCovered(Executor& executor, size_t begin, size_t end, size_t grain) {
+		// Catch2 assertions are not thread safe, so only count the bad ranges inside the workers.
+		std::vector<std::atomic<int>> hits(end);
+		std::atomic<size_t> empty{ 0 };
+		executor.parallel_for(begin, end, grain, [&](size_t first, size_t last) {
+			if (first >= last) {
+				empty.fetch_add(1, std::memory_order_relaxed);
+			}
+			for (size_t i = first; i < last; ++i) {
+				hits[i].fetch_add(1, std::memory_order_relaxed);
+			}
+		});
+		REQUIRE(empty.load() == 0);
+		for (size_t i = 0; i < end; ++i) {
+			REQUIRE(hits[i].load() == (i >= begin ? 1 : 0));
+		}
+	}
+}
+
+TEST_CASE("executors") {
+	SECTION("Serial") {
+		SerialExecutor serial;
+		REQUIRE(serial.concurrency() == 1);
+		requireCovered(serial, 3, 100, 8);
+	}
+	SECTION("Thread pool") {
+		ThreadPool pool(4);
+		REQUIRE(pool.concurrency() == 4);
+		requireCovered(pool, 0, 1000, 1);
+		requireCovered(pool, 5, 1000, 64);
+		requireCovered(pool, 0, 3, 1);
+		requireCovered(pool, 0, 0, 1);
+
+		// Nested calls run on the calling thread instead of waiting on the pool.
+		std::atomic<size_t> total{ 0 };
+		pool.parallel_for(0, 8, 1, [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i) {
+				pool.parallel_for(0, 100, 10, [&](size_t a, size_t b) {
+					total.fetch_add(b - a, std::memory_order_relaxed);
+				});
+			}
+		});
+		REQUIRE(total.load() == 800);
+
+		// The first exception reaches the caller, and the pool keeps working afterwards.
+		std::atomic<size_t> ran{ 0 };
+		REQUIRE_THROWS_AS(pool.parallel_for(0, 1000, 1, [&](size_t first, size_t) {
+			ran.fetch_add(1, std::memory_order_relaxed);
+			if (first % 7 == 3) {
+				throw std::runtime_error("chunk failed");
+			}
+		}), std::runtime_error);
+		REQUIRE(ran.load() < 1000);
+		requireCovered(pool, 0, 1000, 1);
+
+		total = 0;
+		pool.parallel_for(0, 8, 1, [&](size_t first, size_t last) {
+			pool.parallel_for(0, 100, 10, [&](size_t a, size_t b) {
+				total.fetch_add(b - a, std::memory_order_relaxed);
+			});
+		});
+		REQUIRE(total.load() == 800);
+	}
+	SECTION("Single thread pool") {
+		ThreadPool pool(1);
+		REQUIRE(pool.concurrency() == 1);
+		requireCovered(pool, 0, 100, 7);
+	}
+	SECTION("Detection") {
+		STATIC_REQUIRE(detail::IsExecutor<SerialExecutor>::value);
+		STATIC_REQUIRE(detail::IsExecutor<ThreadPool>::value);
+		STATIC_REQUIRE(detail::IsExecutor<ReverseExecutor>::value);
+		STATIC_REQUIRE(!detail::IsExecutor<size_t>::value);
+	}
+}
+
+TEST_CASE("parallel queries") {
+	bbox_t domain(vec_t(-10.f), vec_t(10.f));
+	auto scene = scenes::heavyTailed<3, float>(600, domain, 0.1f, 6.f, 1.2f, 21);
+	size_t count = scene.size();
+
+	ThreadPool pool(4);
+	ReverseExecutor reverse{ 3 };
+
+	SECTION("DVTable") {
+		DVTable<float, index_t, 3> table;
+		table.initialize(vec_t(1.f));
+		table.build(scene.bounds.data(), count);
+
+		PairList<index_t> serial, parallel;
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, serial);
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, parallel, pool);
+		REQUIRE(parallel == serial);
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, parallel, reverse);
+		REQUIRE(parallel == serial);
+		REQUIRE(reverse.calls > 0);
+
+		OverlapList serialList, parallelList;
+		parallelList.setIndexed(true);
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, serialList);
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, parallelList, pool);
+		REQUIRE(parallelList.size() == serialList.size());
+		REQUIRE(parallelList.numPairs() == serialList.numPairs());
+		REQUIRE(std::equal(serialList.begin(), serialList.end(), parallelList.begin(), [](auto a, auto b) {
+			return std::equal(a.begin(), a.end(), b.begin(), b.end());
+		}));
+		// The index of the joined list must point at the same groups.
+		size_t group = 0;
+		for (auto overlaps : serialList) {
+			REQUIRE(parallelList[group++].front() == overlaps.front());
+		}
+
+		OverlapCSR<index_t> serialCSR, parallelCSR;
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, serialCSR);
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, parallelCSR, SerialExecutor{});
+		REQUIRE(parallelCSR.getOffsets() == serialCSR.getOffsets());
+		REQUIRE(parallelCSR.getAdjacency() == serialCSR.getAdjacency());
+	}
+	SECTION("HTable") {
+		HTable<float, index_t, 3> table(vec_t(0.5f), 6);
+		table.build(scene.bounds.data(), count);
+
+		PairList<index_t> serial, parallel;
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, serial);
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, parallel, pool);
+		REQUIRE(parallel == serial);
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, parallel, reverse);
+		REQUIRE(parallel == serial);
+
+		OverlapList serialList, parallelList;
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, serialList);
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, parallelList, pool);
+		REQUIRE(parallelList.numPairs() == serialList.numPairs());
+
+		// The counters of the parts add up to the serial ones.
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, serial);
+		TableStats serialStats = table.stats();
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, parallel, pool);
+		TableStats parallelStats = table.stats();
+		REQUIRE(parallelStats.queries.candidates == serialStats.queries.candidates);
+		REQUIRE(parallelStats.queries.accepted == serialStats.queries.accepted);
+		REQUIRE(parallelStats.queries.accepted == serial.size());
+	}
+	SECTION("Islands and coloring") {
+		DVTable<float, index_t, 3> table;
+		table.initialize(vec_t(1.f));
+		table.build(scene.bounds.data(), count);
+		PairList<index_t> pairs;
+		table.findOverlaps(scene.ids.data(), scene.bounds.data(), count, pairs, pool);
+
+		Islands<index_t> serial, parallel;
+		serial.build(pairs, count);
+		parallel.build(pairs, count, reverse);
+		REQUIRE(parallel.getIds() == serial.getIds());
+		parallel.build(pairs, count, pool);
+		REQUIRE(parallel.getIds() == serial.getIds());
+
+		ConstraintColoring<index_t> serialColors, parallelColors;
+		serialColors.build(pairs, count);
+		parallelColors.build(pairs, count, pool);
+		for (size_t c = 0; c < pairs.size(); ++c) {
+			REQUIRE(parallelColors.colorOf(c) == serialColors.colorOf(c));
+		}
+	}
+}
@@ -1,8 +1,13 @@
 #include <array>
+#include <random>
 
 #include <pbd/common/BBox.hpp>
 #include <pbd/hashing/util.hpp>
 #include <pbd/hashing/Grid.hpp>
+#include <pbd/hashing/HTable.hpp>
+#include <pbd/hashing/DVTable.hpp>
+
+#include <Scenes.hpp>
 
 #include <catch2/catch_all.hpp>
 
@@ -29,4 +34,230 @@ TEST_CASE("grid") {
 	p1 = grid.calcCell(vec_t(0.035));
 	REQUIRE(p0 == ivec_t(2));
 	REQUIRE(p1 == ivec_t(3));
-}
\ No newline at end of file
+}
+TEST_CASE("grid floors negative coordinates") {
+	using grid_t = Grid<int, 3, float>;
+	using vec_t = grid_t::vec_t;
+	using ivec_t = grid_t::ivec_t;
+
+	grid_t grid(vec_t(1.0));
+
+	REQUIRE(grid.calcCell(vec_t(-0.5f)) == ivec_t(-1));
+	REQUIRE(grid.calcCell(vec_t(-1.f)) == ivec_t(-1));
+	REQUIRE(grid.calcCell(vec_t(-1.5f)) == ivec_t(-2));
+	REQUIRE(grid.calcCell(vec_t(0.f)) == ivec_t(0));
+
+	UniformGrid<int, 3, float> uniform(0.5f);
+	REQUIRE(uniform.calcCell(vec_t(-0.25f)) == ivec_t(-1));
+	REQUIRE(uniform.cell() == 0.5f);
+
+	Pow2Grid<int, 3, float, -2> pow2;
+	REQUIRE(pow2.cell() == 0.25f);
+	REQUIRE(pow2.calcCell(vec_t(0.3f)) == ivec_t(1));
+	REQUIRE(pow2.calcCell(vec_t(-0.3f)) == ivec_t(-2));
+	REQUIRE(Pow2Grid<int, 3, float, 3>::cellSize == 8.f);
+}
+
+TEST_CASE("grid origin") {
+	using grid_t = Grid<int, 3, float>;
+	using vec_t = grid_t::vec_t;
+	using ivec_t = grid_t::ivec_t;
+
+	grid_t grid(vec_t(0.5f), vec_t(10.f));
+	REQUIRE(grid.calcCell(vec_t(10.25f)) == ivec_t(0));
+	REQUIRE(grid.calcCell(vec_t(9.75f)) == ivec_t(-1));
+	REQUIRE(grid.calcCell(vec_t(11.f)) == ivec_t(2));
+
+	// The origin snaps to whole cells, on a lattice of the stride.
+	ivec_t shift = grid.rebase(vec_t(13.1f, 10.f, 6.f), 2);
+	REQUIRE(shift == ivec_t(6, 0, -8));
+	REQUIRE(grid.origin().x == Catch::Approx(13.f));
+	REQUIRE(grid.origin().z == Catch::Approx(6.f));
+	REQUIRE(grid.calcCell(vec_t(13.25f, 10.25f, 6.25f)) == ivec_t(0));
+
+	REQUIRE_FALSE(grid.rebaseIfFar(vec_t(14.f, 10.f, 6.f), 5.f));
+	REQUIRE(grid.rebaseIfFar(vec_t(24.f, 10.f, 6.f), 5.f));
+	REQUIRE(grid.origin().x == Catch::Approx(24.f));
+
+	// Far from the world origin the cells stay small and exact.
+	grid_t far(vec_t(0.1f), vec_t(20000.f));
+	REQUIRE(far.calcCell(vec_t(20000.05f)) == ivec_t(0));
+	REQUIRE(far.calcCell(vec_t(19999.95f)) == ivec_t(-1));
+	std::vector<glm::vec3> points{ vec_t(20000.05f), vec_t(20001.05f) };
+	std::vector<glm::ivec3> cells(points.size());
+	far.calcCells(points.data(), points.size(), cells.data());
+	REQUIRE(cells[0] == ivec_t(0));
+	REQUIRE(cells[1] == ivec_t(10));
+}
+
+TEST_CASE("grid batched cells") {
+	using bbox_t = BBox<3, float>;
+
+	std::mt19937 gen(11);
+	std::uniform_real_distribution<float> pos(-50.f, 50.f);
+	std::uniform_real_distribution<float> size(0.f, 5.f);
+
+	// Odd count, so the scalar tail runs after the vectorized blocks.
+	std::vector<glm::vec3> points(1003);
+	std::vector<bbox_t> bounds(points.size());
+	for (size_t i = 0; i < points.size(); ++i) {
+		points[i] = glm::vec3(pos(gen), pos(gen), pos(gen));
+		bounds[i] = bbox_t(points[i], points[i] + glm::vec3(size(gen), size(gen), size(gen)));
+	}
+
+	auto check = [&](const auto& grid) {
+		std::vector<glm::ivec3> cells(points.size()), b0(points.size()), b1(points.size());
+		grid.calcCells(points.data(), points.size(), cells.data());
+		grid.calcBounds(bounds.data(), bounds.size(), b0.data(), b1.data());
+		for (size_t i = 0; i < points.size(); ++i) {
+			REQUIRE(cells[i] == grid.calcCell(points[i]));
+			REQUIRE(b0[i] == grid.calcCell(bounds[i].min));
+			REQUIRE(b1[i] == grid.calcCell(bounds[i].max));
+		}
+	};
+
+	check(Grid<int, 3, float>(glm::vec3(0.7f, 1.3f, 2.f)));
+	check(Grid<int, 3, float>(glm::vec3(0.7f, 1.3f, 2.f), glm::vec3(-3.f, 12.5f, 40.f)));
+	check(UniformGrid<int, 3, float>(0.9f));
+	check(Pow2Grid<int, 3, float, 1>{});
+}
+
+TEST_CASE("grid from bounds") {
+	using grid_t = Grid<int, 3, float>;
+	using vec_t = grid_t::vec_t;
+	using bbox_t = BBox<3, float>;
+
+	bbox_t domain(vec_t(-20.f), vec_t(20.f));
+
+	SECTION("Cell size follows the box size") {
+		auto small = scenes::uniformPoints<3, float>(2000, domain, 0.1f, 1);
+		auto large = scenes::uniformPoints<3, float>(2000, domain, 1.f, 1);
+
+		grid_t a = grid_t::fromBounds(small.bounds.data(), small.size());
+		grid_t b = grid_t::fromBounds(large.bounds.data(), large.size());
+		REQUIRE(a.cell().x < b.cell().x);
+		// Cells much smaller than the boxes create too many entries.
+		REQUIRE(b.cell().x >= 1.f);
+	}
+
+	SECTION("Each axis follows the extents along it") {
+		auto scene = scenes::uniformPoints<3, float>(2000, domain, 0.2f, 2);
+		for (bbox_t& box : scene.bounds) {
+			box.max.x += 4.f;
+		}
+		grid_t grid = grid_t::fromBounds(scene.bounds.data(), scene.size());
+		REQUIRE(grid.cell().x > 2.f * grid.cell().y);
+
+		CellSizePolicy<float> policy;
+		policy.uniform = true;
+		grid = grid_t::fromBounds(scene.bounds.data(), scene.size(), policy);
+		REQUIRE(grid.cell().x == grid.cell().y);
+	}
+
+	SECTION("Tiers cover the largest boxes") {
+		auto scene = scenes::heavyTailed<3, float>(2000, domain, 0.05f, 30.f, 1.2f, 3);
+		CellSizeChoice<3, float> flat = chooseCellSize(scene.bounds.data(), scene.size());
+		CellSizeChoice<3, float> tiered = chooseCellSize(scene.bounds.data(), scene.size(), 16);
+		REQUIRE(flat.tiers == 1);
+		REQUIRE(tiered.tiers > 1);
+		REQUIRE(tiered.tiers <= 16);
+
+		HTable<float, int32_t, 3> table;
+		table.initialize(scene.bounds.data(), scene.size());
+		REQUIRE(table.numTiers() == tiered.tiers);
+	}
+
+	SECTION("Tuner") {
+		auto scene = scenes::uniformPoints<3, float>(1000, domain, 0.5f, 4);
+		CellSizeTuner<3, float> tuner(3);
+
+		REQUIRE(tuner.update(scene.bounds.data(), scene.size()));
+		vec_t first = tuner.choice().cell;
+		for (int i = 0; i < 6; ++i) {
+			REQUIRE_FALSE(tuner.update(scene.bounds.data(), scene.size()));
+		}
+
+		// The boxes grow, the next check picks a larger cell.
+		for (bbox_t& box : scene.bounds) {
+			box.expand(2.f);
+		}
+		bool changed = false;
+		for (int i = 0; i < 3; ++i) {
+			changed |= tuner.update(scene.bounds.data(), scene.size());
+		}
+		REQUIRE(changed);
+		REQUIRE(tuner.choice().cell.x > first.x);
+	}
+}
+
+TEST_CASE("grid policies") {
+	using scene_t = scenes::Scene<3, float>;
+	using bbox_t = scene_t::bbox_t;
+	using vec_t = scene_t::vec_t;
+	using index_t = int32_t;
+
+	bbox_t domain(vec_t(-8.f), vec_t(8.f));
+	scene_t scene = scenes::heavyTailed<3, float>(400, domain, 0.1f, 6.f, 1.5f, 8);
+	scenes::PairSet<index_t> expected = scenes::bruteForce(scene.bounds, scene.ids);
+	PairList<index_t> pairs;
+
+	using uniform_t = UniformGrid<index_t, 3, float>;
+	using pow2_t = Pow2Grid<index_t, 3, float, -1>;
+
+	SECTION("DVTable") {
+		DVTable<float, index_t, 3, uniform_t> uniform;
+		uniform.initialize(uniform_t(0.75f));
+		uniform.build(scene.bounds.data(), scene.size());
+		uniform.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+		REQUIRE(scenes::collect(pairs) == expected);
+
+		DVTable<float, index_t, 3, pow2_t> pow2;
+		pow2.build(scene.bounds.data(), scene.size());
+		pow2.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+		REQUIRE(scenes::collect(pairs) == expected);
+	}
+	SECTION("HTable") {
+		HTable<float, index_t, 3, 64, uniform_t> uniform(uniform_t(0.75f), 5);
+		uniform.build(scene.bounds.data(), scene.size());
+		uniform.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+		REQUIRE(scenes::collect(pairs) == expected);
+
+		HTable<float, index_t, 3, 64, pow2_t> pow2(pow2_t{}, 5);
+		pow2.build(scene.bounds.data(), scene.size());
+		pow2.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+		REQUIRE(scenes::collect(pairs) == expected);
+	}
+}
+
+TEST_CASE("rebased tables far from the origin") {
+	using scene_t = scenes::Scene<3, float>;
+	using bbox_t = scene_t::bbox_t;
+	using vec_t = scene_t::vec_t;
+	using index_t = int32_t;
+
+	bbox_t domain(vec_t(-8.f), vec_t(8.f));
+	scene_t scene = scenes::uniformPoints<3, float>(400, domain, 0.5f, 9);
+
+	// Move the scene twenty kilometers away.
+	vec_t offset(20000.f, -15000.f, 5000.f);
+	for (size_t i = 0; i < scene.size(); ++i) {
+		scene.points[i] += offset;
+		scene.bounds[i].translate(offset);
+	}
+	scenes::PairSet<index_t> expected = scenes::bruteForce(scene.bounds, scene.ids);
+	PairList<index_t> pairs;
+
+	HTable<float, index_t, 3> htable(vec_t(1.f), 4);
+	htable.rebase(offset);
+	REQUIRE(htable.getGrid().origin().x == Catch::Approx(offset.x));
+	htable.build(scene.bounds.data(), scene.size());
+	htable.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+	REQUIRE(scenes::collect(pairs) == expected);
+
+	DVTable<float, index_t, 3> dvtable;
+	dvtable.initialize(vec_t(1.f));
+	dvtable.rebase(offset);
+	dvtable.build(scene.bounds.data(), scene.size());
+	dvtable.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+	REQUIRE(scenes::collect(pairs) == expected);
+}
@@ -1,11 +1,15 @@
 #include <glm/gtx/io.hpp>
 #include <array>
+#include <random>
+#include <set>
 
 #include <pbd/common/BBox.hpp>
 #include <pbd/hashing/util.hpp>
 #include <pbd/hashing/Grid.hpp>
 #include <pbd/hashing/HTable.hpp>
 
+#include <Scenes.hpp>
+
 #include <catch2/catch_all.hpp>
 
 using namespace pbd;
@@ -325,4 +329,234 @@ TEST_CASE("HTable") {
 		REQUIRE(group.contains(2));
 		REQUIRE(group.contains(3));
 	}
-}
\ No newline at end of file
+
+	SECTION("Bound overlap, sharing several cells") {
+		// Both bounds land in the second tier, spanning two cells each.
+		add(vec_t(0.5), vec_t(2.5), 0);
+		add(vec_t(0.6), vec_t(2.4), 1);
+
+		prep();
+
+		REQUIRE(overlapList.size() == 1);
+		auto overlaps = *overlapList.begin();
+		REQUIRE(overlaps.size() == 2);
+		group.insert(overlaps[0]);
+		group.insert(overlaps[1]);
+		REQUIRE(group.contains(0));
+		REQUIRE(group.contains(1));
+	}
+
+	SECTION("Random bounds match brute force") {
+		std::mt19937 gen(42);
+		std::uniform_real_distribution<float> pos(-10.f, 10.f);
+		std::exponential_distribution<float> size(1.f);
+
+		for (index_t i = 0; i < 300; ++i) {
+			vec_t min(pos(gen), pos(gen), pos(gen));
+			vec_t ext(size(gen), size(gen), size(gen));
+			add(min, min + ext, i);
+		}
+
+		prep();
+
+		std::set<std::pair<index_t, index_t>> expected, found;
+		for (index_t i = 0; i < bounds.size(); ++i) {
+			for (index_t j = 0; j < i; ++j) {
+				if (bounds[i].overlaps(bounds[j])) {
+					expected.insert({ j, i });
+				}
+			}
+		}
+
+		for (auto overlaps : overlapList) {
+			index_t first = overlaps.front();
+			for (size_t k = 1; k < overlaps.size(); ++k) {
+				std::pair<index_t, index_t> pair{ std::min(first, overlaps[k]), std::max(first, overlaps[k]) };
+				// Every pairing must be reported exactly once.
+				REQUIRE(found.insert(pair).second);
+			}
+		}
+
+		REQUIRE(found == expected);
+	}
+
+	SECTION("Parity batches") {
+		add(vec_t(0.1), vec_t(0.9), 0);
+		add(vec_t(1.1), vec_t(1.9), 1);
+		add(vec_t(2.1), vec_t(2.9), 2);
+		add(vec_t(0.1), vec_t(1.9), 3);
+
+		prep();
+
+		std::vector<Table::parity_batches_t> tiers;
+		table.parityBatches(tiers);
+		REQUIRE(tiers.size() == table.numTiers());
+
+		// First tier: cells (0,0,0), (1,1,1) and (2,2,2).
+		REQUIRE(tiers[0][0].size() == 2);
+		REQUIRE(tiers[0][7].size() == 1);
+		REQUIRE(tiers[0][7].front().cell().index == ivec_t(1));
+
+		// Second tier: cell (0,0,0).
+		REQUIRE(tiers[1][0].size() == 1);
+		REQUIRE(tiers[1][0].front().cell().tier == 1);
+		REQUIRE(tiers[2][0].empty());
+	}
+}
+
+TEST_CASE("HTable 64 bit entry offsets") {
+	using wide_t = HTable<float, int32_t, 3, 64, Grid<int32_t, 3, float>, int64_t>;
+	using scene_t = scenes::Scene<3, float>;
+	using bbox_t = scene_t::bbox_t;
+	using vec_t = scene_t::vec_t;
+	using index_t = int32_t;
+	static_assert(std::is_same_v<wide_t::offset_t, int64_t>);
+	// Ids stay 32 bit, only the map values grow.
+	static_assert(std::is_same_v<wide_t::entries_t::value_type, index_t>);
+	static_assert(std::is_same_v<Table::offset_t, index_t>);
+
+	bbox_t domain(vec_t(-8.f), vec_t(8.f));
+	scene_t scene = scenes::heavyTailed<3, float>(300, domain, 0.05f, 6.f, 1.1f, 10);
+	PairList<index_t> pairs;
+
+	wide_t table(vec_t(1.f), 4);
+	table.build(scene.bounds.data(), scene.size());
+	table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+	REQUIRE(scenes::collect(pairs) == scenes::bruteForce(scene.bounds, scene.ids));
+}
+
+TEST_CASE("HTable visiting overlaps") {
+	using scene_t = scenes::Scene<3, float>;
+	using bbox_t = scene_t::bbox_t;
+	using vec_t = scene_t::vec_t;
+	using index_t = int32_t;
+
+	bbox_t domain(vec_t(-8.f), vec_t(8.f));
+	scene_t scene = scenes::gaussianClusters<3, float>(400, 4, domain, 1.f, 0.2f, 14);
+	scenes::PairSet<index_t> expected = scenes::bruteForce(scene.bounds, scene.ids);
+	REQUIRE(expected.size() > 10);
+
+	Table table(vec_t(1.f), 4);
+	table.build(scene.bounds.data(), scene.size());
+
+	// Same pairs in the same order as the flat list.
+	PairList<index_t> pairs, visited;
+	table.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+	REQUIRE(table.forEachOverlap(scene.ids.data(), scene.bounds.data(), scene.size(), [&](index_t a, index_t b) {
+		visited.emplace_back(a, b);
+	}));
+	REQUIRE(visited == pairs);
+	REQUIRE(scenes::collect(visited) == expected);
+
+	// Stop after a few pairs.
+	visited.clear();
+	bool finished = table.forEachOverlap(scene.ids.data(), scene.bounds.data(), scene.size(), [&](index_t a, index_t b) {
+		visited.emplace_back(a, b);
+		return visited.size() < 5;
+	});
+	REQUIRE_FALSE(finished);
+	REQUIRE(visited.size() == 5);
+	REQUIRE(std::equal(visited.begin(), visited.end(), pairs.begin()));
+
+	// Returning true all the way visits everything.
+	size_t count = 0;
+	REQUIRE(table.forEachOverlap(scene.ids.data(), scene.bounds.data(), scene.size(), [&](index_t, index_t) {
+		++count;
+		return true;
+	}));
+	REQUIRE(count == pairs.size());
+}
+
+TEST_CASE("sphere tables") {
+	using bbox_t = Table::bbox_t;
+	using index_t = Table::index_t;
+	using vec_t = Table::vec_t;
+	using pair_set_t = scenes::PairSet<index_t>;
+
+	const size_t count = 600;
+	scenes::Random random(37);
+
+	std::vector<vec_t> centers(count);
+	std::vector<float> radii(count);
+	std::vector<index_t> ids(count);
+	for (size_t i = 0; i < count; ++i) {
+		for (glm::length_t k = 0; k < 3; ++k) {
+			centers[i][k] = random.uniform(-8.f, 8.f);
+		}
+		// Mostly small particles with a few large ones, so several tiers are used.
+		radii[i] = i % 50 == 0 ? random.uniform(1.f, 3.f) : random.uniform(0.05f, 0.4f);
+		ids[i] = static_cast<index_t>(i);
+	}
+
+	auto boundsOf = [&](const SphereOverlap<3, float>& spheres) {
+		std::vector<bbox_t> bounds(count);
+		for (size_t i = 0; i < count; ++i) {
+			bounds[i] = spheres.bounds(i);
+		}
+		return bounds;
+	};
+
+	Table spheresTable(vec_t(0.25f), 6), boxesTable(vec_t(0.25f), 6);
+	PairList<index_t> pairs, boxPairs;
+
+	SECTION("Per object radius") {
+		SphereOverlap<3, float> spheres{ centers.data(), radii.data() };
+		std::vector<bbox_t> bounds = boundsOf(spheres);
+		pair_set_t expected = scenes::bruteForce(bounds, ids, spheres);
+
+		spheresTable.build(centers.data(), radii.data(), count);
+		spheresTable.findOverlaps(ids.data(), spheres, count, pairs);
+		REQUIRE(scenes::collect(pairs) == expected);
+
+		// Same cells and the same pairs, in the same order, as building from the boxes.
+		boxesTable.build(bounds.data(), count);
+		REQUIRE(spheresTable.numCells() == boxesTable.numCells());
+		boxesTable.findOverlaps(ids.data(), bounds.data(), count, boxPairs, spheres);
+		REQUIRE(pairs == boxPairs);
+
+		spheresTable.findOverlaps(ids.data(), spheres, count, pairs, ThreadPool(3));
+		REQUIRE(pairs == boxPairs);
+
+		OverlapList list;
+		spheresTable.findOverlaps(ids.data(), spheres, count, list);
+		REQUIRE(list.numPairs() == expected.size());
+		spheresTable.findOverlaps(ids.data(), spheres, count, list, ThreadPool(3));
+		REQUIRE(list.numPairs() == expected.size());
+
+		OverlapCSR<index_t> csr;
+		spheresTable.findOverlaps(ids.data(), spheres, count, csr);
+		REQUIRE(csr.numPairs() == expected.size());
+		spheresTable.findOverlaps(ids.data(), spheres, count, csr, SerialExecutor{});
+		REQUIRE(csr.numPairs() == expected.size());
+
+		// An extra predicate runs after the sphere test.
+		auto even = [](index_t a, index_t b) {
+			return (a + b) % 2 == 0;
+		};
+		spheresTable.findOverlaps(ids.data(), spheres, count, pairs, even);
+		REQUIRE(scenes::collect(pairs) == scenes::bruteForce(bounds, ids, [&](index_t a, index_t b) {
+			return spheres(a, b) && even(a, b);
+		}));
+
+		size_t visited = 0;
+		REQUIRE(spheresTable.forEachOverlap(ids.data(), spheres, count, [&](index_t a, index_t b) {
+			REQUIRE(expected.count({ std::min(a, b), std::max(a, b) }) == 1);
+			++visited;
+		}));
+		REQUIRE(visited == expected.size());
+	}
+	SECTION("Uniform radius") {
+		SphereOverlap<3, float> spheres{ centers.data(), nullptr, 0.3f };
+		std::vector<bbox_t> bounds = boundsOf(spheres);
+		pair_set_t expected = scenes::bruteForce(bounds, ids, spheres);
+		REQUIRE(expected.size() < scenes::bruteForce(bounds, ids, BoxOverlap{}).size());
+
+		spheresTable.build(0.3f, centers.data(), count);
+		spheresTable.findOverlaps(ids.data(), spheres, count, pairs);
+		REQUIRE(scenes::collect(pairs) == expected);
+
+		boxesTable.build(bounds.data(), count);
+		boxesTable.findOverlaps(ids.data(), bounds.data(), count, boxPairs, spheres);
+		REQUIRE(pairs == boxPairs);
+	}
+}
@@ -0,0 +1,82 @@
+#include <array>
+#include <random>
+
+#include <pbd/hashing/Islands.hpp>
+
+#include <catch2/catch_all.hpp>
+
+using namespace pbd;
+
+TEST_CASE("Islands") {
+	using index_t = int32_t;
+
+	Islands<index_t> islands;
+	REQUIRE(islands.size() == 0);
+
+	SECTION("Small graph") {
+		// Islands: {0, 2, 5}, {1}, {3, 4}, {6}
+		PairList<index_t> pairs{ {5, 2}, {4, 3}, {0, 5} };
+
+		islands.build(pairs, 7);
+
+		REQUIRE(islands.numIds() == 7);
+		REQUIRE(islands.size() == 4);
+
+		REQUIRE(islands.islandOf(0) == 0);
+		REQUIRE(islands.islandOf(2) == 0);
+		REQUIRE(islands.islandOf(5) == 0);
+		REQUIRE(islands.islandOf(1) == 1);
+		REQUIRE(islands.islandOf(3) == 2);
+		REQUIRE(islands.islandOf(4) == 2);
+		REQUIRE(islands.islandOf(6) == 3);
+
+		auto island = islands[0];
+		REQUIRE(island.size() == 3);
+		REQUIRE(island[0] == 0);
+		REQUIRE(island[1] == 2);
+		REQUIRE(island[2] == 5);
+
+		REQUIRE(islands[1].size() == 1);
+		REQUIRE(islands[2].size() == 2);
+		REQUIRE(islands[3].size() == 1);
+	}
+
+	SECTION("Threaded matches serial") {
+		std::mt19937 gen(99);
+		const index_t nids = 2000;
+		std::uniform_int_distribution<index_t> pick(0, nids - 1);
+
+		PairList<index_t> pairs;
+		OverlapList list;
+		list.setIndexed(true);
+		for (int g = 0; g < 600; ++g) {
+			index_t first = pick(gen);
+			list.group();
+			list.push(first);
+			for (int k = 0; k < 2; ++k) {
+				index_t other = pick(gen);
+				if (other != first) {
+					list.push(other);
+					pairs.emplace_back(first, other);
+				}
+			}
+			list.ungroup();
+		}
+
+		Islands<index_t> serial;
+		serial.build(pairs, nids);
+
+		islands.build(list, nids, 4);
+		REQUIRE(islands.size() == serial.size());
+		REQUIRE(islands.getIds() == serial.getIds());
+		REQUIRE(islands.getOffsets() == serial.getOffsets());
+
+		islands.build(pairs, nids, 4);
+		REQUIRE(islands.getIds() == serial.getIds());
+
+		// Every pair must end up in the same island.
+		for (auto& pair : pairs) {
+			REQUIRE(islands.islandOf(pair.first) == islands.islandOf(pair.second));
+		}
+	}
+}
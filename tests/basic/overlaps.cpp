@@ -77,4 +77,166 @@ TEST_CASE("overlaps") {
 	it = list.begin();
 	end = list.end();
 	REQUIRE(it == end);
+}
+
+TEST_CASE("overlaps dedupe") {
+	using index_t = OverlapList::index_t;
+
+	OverlapList list;
+
+	// Duplicates in a small group.
+	list.group();
+	list.push(1);
+	list.push(2);
+	list.push(1);
+	list.push(2);
+	list.push(3);
+	list.ungroup();
+
+	REQUIRE(list.size() == 1);
+	auto overlaps = *list.begin();
+	REQUIRE(overlaps.size() == 3);
+	REQUIRE(overlaps[0] == 1);
+	REQUIRE(overlaps[1] == 2);
+	REQUIRE(overlaps[2] == 3);
+
+	// Duplicates in a group large enough to switch over to the stamps.
+	index_t large = OverlapList::SmallGroup * 4;
+	list.clear();
+	list.group();
+	for (int pass = 0; pass < 3; ++pass) {
+		for (index_t i = large; i > 0; --i) {
+			list.push(i * 7);
+		}
+	}
+	list.ungroup();
+
+	REQUIRE(list.size() == 1);
+	overlaps = *list.begin();
+	REQUIRE(overlaps.size() == large);
+	for (index_t i = 0; i < large; ++i) {
+		REQUIRE(overlaps[i] == (large - i) * 7);
+	}
+
+	// Ids from the previous group must not be considered duplicates in the next one.
+	list.group();
+	list.push(7);
+	list.push(14);
+	list.push(7);
+	list.ungroup();
+
+	REQUIRE(list.size() == 2);
+	auto it = list.begin();
+	++it;
+	overlaps = *it;
+	REQUIRE(overlaps.size() == 2);
+	REQUIRE(overlaps[0] == 7);
+	REQUIRE(overlaps[1] == 14);
+}
+
+TEST_CASE("overlaps dedupe sparse ids") {
+	using index_t = OverlapList::index_t;
+
+	OverlapList list;
+
+	// Ids far past the stamps go to the hash set instead of growing the stamps up to them.
+	index_t stride = index_t(1) << 26;
+	list.group();
+	for (int pass = 0; pass < 3; ++pass) {
+		for (index_t i = 0; i < 20; ++i) {
+			list.push(i * stride);
+		}
+	}
+	list.ungroup();
+
+	REQUIRE(list.size() == 1);
+	auto overlaps = *list.begin();
+	REQUIRE(overlaps.size() == 20);
+	for (index_t i = 0; i < 20; ++i) {
+		REQUIRE(overlaps[i] == i * stride);
+	}
+
+	// A group already on the stamps moves over when a large id shows up, keeping the ids it had.
+	list.clear();
+	list.group();
+	for (index_t i = 0; i < 20; ++i) {
+		list.push(i);
+	}
+	list.push(2000000000);
+	list.push(5);
+	list.push(2000000000);
+	for (index_t i = 0; i < 30; ++i) {
+		list.push(i);
+	}
+	list.ungroup();
+
+	// The next group is back on the stamps, and doesn't see the ids of the previous one.
+	list.group();
+	for (index_t i = 0; i < 12; ++i) {
+		list.push(i);
+		list.push(i);
+	}
+	list.ungroup();
+
+	REQUIRE(list.size() == 2);
+	auto it = list.begin();
+	REQUIRE((*it).size() == 31);
+	REQUIRE((*it)[20] == 2000000000);
+	++it;
+	REQUIRE((*it).size() == 12);
+}
+
+TEST_CASE("overlaps index") {
+	using index_t = OverlapList::index_t;
+
+	OverlapList list;
+
+	// Group i holds i+2 ids, so i+1 pairs.
+	auto fill = [&](index_t from, index_t to) {
+		for (index_t i = from; i < to; ++i) {
+			list.group();
+			for (index_t j = 0; j < i + 2; ++j) {
+				list.push(j);
+			}
+			list.ungroup();
+		}
+	};
+
+	// Enable the index after some groups were added, then keep adding.
+	fill(0, 10);
+	list.setIndexed(true);
+	fill(10, 20);
+
+	REQUIRE(list.isIndexed());
+	REQUIRE(list.size() == 20);
+	REQUIRE(list.numPairs() == 210);
+
+	for (size_t i = 0; i < list.size(); ++i) {
+		REQUIRE(list[i].size() == i + 2);
+		REQUIRE((*list.at(i)).size() == i + 2);
+	}
+	REQUIRE(list.at(list.size()) == list.end());
+
+	std::vector<size_t> bounds = list.split(4);
+	REQUIRE(bounds.size() == 5);
+	REQUIRE(bounds.front() == 0);
+	REQUIRE(bounds.back() == list.size());
+
+	size_t total = 0;
+	for (size_t part = 0; part < 4; ++part) {
+		REQUIRE(bounds[part] <= bounds[part + 1]);
+
+		size_t pairs = 0;
+		for (auto it = list.at(bounds[part]), last = list.at(bounds[part + 1]); it != last; ++it) {
+			pairs += (*it).size() - 1;
+		}
+		// Each part is within one group of the ideal balance.
+		REQUIRE(pairs <= 210 / 4 + 21);
+		total += pairs;
+	}
+	REQUIRE(total == 210);
+
+	list.clear();
+	REQUIRE(list.numPairs() == 0);
+	REQUIRE(list.split(3) == std::vector<size_t>{ 0, 0, 0, 0 });
 }
\ No newline at end of file
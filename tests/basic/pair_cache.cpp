@@ -0,0 +1,85 @@
+#include <array>
+
+#include <pbd/hashing/PairCache.hpp>
+
+#include <catch2/catch_all.hpp>
+
+using namespace pbd;
+
+TEST_CASE("PairCache") {
+	using Cache = PairCache<int, int32_t>;
+	using Entry = Cache::Entry;
+
+	Cache cache;
+	REQUIRE(cache.empty());
+
+	// First frame, everything is new.
+	cache.begin();
+	cache.add(3, 1);
+	cache.add(1, 2);
+	cache.add(1, 3);
+	cache.end();
+
+	REQUIRE(cache.size() == 2);
+	REQUIRE(cache.added().size() == 2);
+	REQUIRE(cache.persisting().empty());
+	REQUIRE(cache.removed().empty());
+
+	REQUIRE(cache[0].first == 1);
+	REQUIRE(cache[0].second == 2);
+	REQUIRE(cache[1].first == 1);
+	REQUIRE(cache[1].second == 3);
+
+	// Attach some data to the new pairs.
+	for (size_t i : cache.added()) {
+		REQUIRE(cache[i].payload == 0);
+		cache[i].payload = cache[i].first * 10 + cache[i].second;
+	}
+
+	// Second frame, (1, 2) ends, (1, 3) persists, (0, 4) starts.
+	OverlapList list;
+	list.group();
+	list.push(3);
+	list.push(1);
+	list.ungroup();
+	list.group();
+	list.push(4);
+	list.push(0);
+	list.ungroup();
+
+	cache.begin();
+	cache.add(list);
+	cache.end();
+
+	REQUIRE(cache.size() == 2);
+
+	REQUIRE(cache.added().size() == 1);
+	const Entry& added = cache[cache.added()[0]];
+	REQUIRE(added.first == 0);
+	REQUIRE(added.second == 4);
+	REQUIRE(added.payload == 0);
+
+	REQUIRE(cache.persisting().size() == 1);
+	const Entry& persisting = cache[cache.persisting()[0]];
+	REQUIRE(persisting.first == 1);
+	REQUIRE(persisting.second == 3);
+	REQUIRE(persisting.payload == 13);
+
+	REQUIRE(cache.removed().size() == 1);
+	REQUIRE(cache.removed()[0].first == 1);
+	REQUIRE(cache.removed()[0].second == 2);
+	REQUIRE(cache.removed()[0].payload == 12);
+
+	REQUIRE(cache.find(3, 1) != nullptr);
+	REQUIRE(cache.find(3, 1)->payload == 13);
+	REQUIRE(cache.find(1, 2) == nullptr);
+
+	// Empty frame ends everything.
+	cache.begin();
+	cache.end();
+
+	REQUIRE(cache.empty());
+	REQUIRE(cache.added().empty());
+	REQUIRE(cache.persisting().empty());
+	REQUIRE(cache.removed().size() == 2);
+}
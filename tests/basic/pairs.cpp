@@ -0,0 +1,130 @@
+#include <array>
+#include <random>
+
+#include <pbd/common/BBox.hpp>
+#include <pbd/hashing/HTable.hpp>
+#include <pbd/hashing/DVTable.hpp>
+#include <pbd/hashing/SortTable.hpp>
+#include <pbd/hashing/OverlapSink.hpp>
+
+#include <Scenes.hpp>
+
+#include <catch2/catch_all.hpp>
+
+using namespace pbd;
+
+using bbox_t = BBox<3, float>;
+using vec_t = bbox_t::vec_t;
+using index_t = int32_t;
+using pair_set_t = scenes::PairSet<index_t>;
+
+static std::pair<index_t, index_t> ordered(index_t a, index_t b) {
+	return { std::min(a, b), std::max(a, b) };
+}
+
+static void randomScene(std::vector<index_t>& ids, std::vector<bbox_t>& bounds, size_t count) {
+	std::mt19937 gen(7);
+	std::uniform_real_distribution<float> pos(-10.f, 10.f);
+	std::exponential_distribution<float> size(1.5f);
+
+	for (size_t i = 0; i < count; ++i) {
+		vec_t min(pos(gen), pos(gen), pos(gen));
+		vec_t ext(size(gen), size(gen), size(gen));
+		bounds.push_back(bbox_t(min, min + ext));
+		// Sparse ids, to make sure the tables don't confuse ids and indices.
+		ids.push_back(static_cast<index_t>(i * 3 + 1));
+	}
+}
+
+static pair_set_t fromCSR(const OverlapCSR<index_t>& csr) {
+	pair_set_t result;
+	for (index_t v = 0; v < static_cast<index_t>(csr.size()); ++v) {
+		for (index_t other : csr[v]) {
+			// The adjacency is symmetric, take each pair from its lower vertex.
+			if (v < other) {
+				result.insert({ v, other });
+			}
+		}
+	}
+	REQUIRE(result.size() == csr.numPairs());
+	return result;
+}
+
+TEST_CASE("overlap output formats") {
+	std::vector<index_t> ids;
+	std::vector<bbox_t> bounds;
+	randomScene(ids, bounds, 400);
+
+	pair_set_t expected = scenes::bruteForce(bounds, ids);
+	REQUIRE(!expected.empty());
+
+	PairList<index_t> pairs;
+	OverlapCSR<index_t> csr;
+
+	SECTION("HTable") {
+		HTable<float, index_t, 3> table(vec_t(1), 4);
+		table.build(bounds.data(), bounds.size());
+
+		table.findOverlaps(ids.data(), bounds.data(), bounds.size(), pairs);
+		REQUIRE(scenes::collect(pairs) == expected);
+
+		table.findOverlaps(ids.data(), bounds.data(), bounds.size(), csr);
+		REQUIRE(fromCSR(csr) == expected);
+	}
+	SECTION("DVTable") {
+		DVTable<float, index_t, 3> table;
+		table.initialize(vec_t(2));
+		table.build(bounds.data(), bounds.size());
+
+		table.findOverlaps(ids.data(), bounds.data(), bounds.size(), pairs);
+		REQUIRE(scenes::collect(pairs) == expected);
+
+		table.findOverlaps(ids.data(), bounds.data(), bounds.size(), csr);
+		REQUIRE(fromCSR(csr) == expected);
+
+		OverlapList list;
+		table.findOverlaps(ids.data(), bounds.data(), bounds.size(), list);
+		pair_set_t found;
+		for (auto overlaps : list) {
+			for (size_t k = 1; k < overlaps.size(); ++k) {
+				found.insert(ordered(overlaps.front(), overlaps[k]));
+			}
+		}
+		REQUIRE(found == expected);
+	}
+	SECTION("SortTable") {
+		SortTable table;
+		table.build(ids.data(), bounds.data(), bounds.size());
+
+		table.findOverlaps(pairs);
+		REQUIRE(scenes::collect(pairs) == expected);
+
+		table.findOverlaps(csr);
+		REQUIRE(fromCSR(csr) == expected);
+	}
+}
+
+TEST_CASE("OverlapCSR") {
+	using pair_t = OverlapCSR<index_t>::pair_t;
+
+	OverlapCSR<index_t> csr;
+	REQUIRE(csr.size() == 0);
+
+	std::vector<pair_t> pairs{ {0, 2}, {2, 3}, {0, 3} };
+	csr.assign(pairs, 5);
+
+	REQUIRE(csr.size() == 5);
+	REQUIRE(csr.numPairs() == 3);
+	REQUIRE(csr[0].size() == 2);
+	REQUIRE(csr[1].empty());
+	REQUIRE(csr[2].size() == 2);
+	REQUIRE(csr[3].size() == 2);
+	REQUIRE(csr[4].empty());
+
+	REQUIRE(csr[0][0] == 2);
+	REQUIRE(csr[0][1] == 3);
+	REQUIRE(csr[2][0] == 0);
+	REQUIRE(csr[2][1] == 3);
+	REQUIRE(csr[3][0] == 2);
+	REQUIRE(csr[3][1] == 0);
+}
@@ -0,0 +1,95 @@
+#include <array>
+#include <random>
+#include <set>
+
+#include <pbd/common/BBox.hpp>
+#include <pbd/hashing/PartitionTable.hpp>
+
+#include <catch2/catch_all.hpp>
+
+using namespace pbd;
+
+TEST_CASE("PartitionTable") {
+	using Table = PartitionTable<float, int32_t, 3>;
+	using bbox_t = Table::bbox_t;
+	using vec_t = Table::vec_t;
+	using index_t = Table::index_t;
+
+	std::mt19937 gen(11);
+	std::uniform_real_distribution<float> pos(-10.f, 10.f);
+	std::exponential_distribution<float> size(1.f);
+
+	std::vector<bbox_t> bounds;
+	std::vector<index_t> ids;
+	for (index_t i = 0; i < 400; ++i) {
+		vec_t min(pos(gen), pos(gen), pos(gen));
+		vec_t ext(size(gen), size(gen), size(gen));
+		bounds.push_back(bbox_t(min, min + ext));
+		ids.push_back(i);
+	}
+
+	std::set<std::pair<index_t, index_t>> expected;
+	for (index_t i = 0; i < bounds.size(); ++i) {
+		for (index_t j = 0; j < i; ++j) {
+			if (bounds[i].overlaps(bounds[j])) {
+				expected.insert({ j, i });
+			}
+		}
+	}
+
+	vec_t spacing = Table::suggestSpacing(bounds.data(), bounds.size(), 0.75f);
+	REQUIRE(glm::all(glm::greaterThan(spacing, vec_t(0.f))));
+
+	auto policy = GENERATE(Encapsulation::Partial, Encapsulation::Total);
+	Table table;
+	table.initialize(Table::suggestGrid(bounds.data(), bounds.size(), 0.75f), policy);
+	REQUIRE(table.getPolicy() == policy);
+	REQUIRE(table.getGrid().cell() == spacing);
+
+	table.build(bounds.data(), bounds.size());
+	REQUIRE(table.numPartitions() > 0);
+	if (policy == Encapsulation::Partial) {
+		REQUIRE(table.numLeftovers() == 0);
+	}
+	else {
+		// Some of the boxes are too large for the spacing.
+		REQUIRE(table.numLeftovers() > 0);
+		REQUIRE(table.numLeftovers() < bounds.size() / 2);
+	}
+
+	OverlapList list;
+	table.findOverlaps(ids.data(), bounds.data(), bounds.size(), list);
+
+	std::set<std::pair<index_t, index_t>> found;
+	for (auto overlaps : list) {
+		index_t first = overlaps.front();
+		for (size_t k = 1; k < overlaps.size(); ++k) {
+			// Every pairing must be reported exactly once.
+			REQUIRE(found.insert({ std::min(first, overlaps[k]), std::max(first, overlaps[k]) }).second);
+		}
+	}
+	REQUIRE(found == expected);
+}
+
+TEST_CASE("PartitionTable phase") {
+	using Table = PartitionTable<float, int32_t, 3>;
+	using bbox_t = Table::bbox_t;
+	using vec_t = Table::vec_t;
+
+	// Boxes a bit narrower than two cells, starting half a cell past the planes through the origin.
+	// Every one of them spans three cells of the grid at the origin, but fits into one partition once the planes move.
+	std::vector<bbox_t> bounds;
+	for (int k = 0; k < 10; ++k) {
+		vec_t min(3.f * k + 0.5f);
+		bounds.push_back(bbox_t(min, min + vec_t(1.9f)));
+	}
+
+	Table table(vec_t(1.f), Encapsulation::Total);
+	table.build(bounds.data(), bounds.size());
+	REQUIRE(table.numLeftovers() == bounds.size());
+
+	vec_t origin = Table::suggestOrigin(bounds.data(), bounds.size(), vec_t(1.f));
+	table.initialize(Table::grid_t(vec_t(1.f), origin), Encapsulation::Total);
+	table.build(bounds.data(), bounds.size());
+	REQUIRE(table.numLeftovers() == 0);
+}
@@ -0,0 +1,133 @@
+#include <pbd/common/BBox.hpp>
+#include <pbd/hashing/Predicates.hpp>
+#include <pbd/hashing/DVTable.hpp>
+#include <pbd/hashing/HTable.hpp>
+#include <pbd/hashing/DenseTable.hpp>
+#include <pbd/hashing/Executor.hpp>
+
+#include <Scenes.hpp>
+
+#include <catch2/catch_all.hpp>
+
+using namespace pbd;
+
+using index_t = int32_t;
+using bbox_t = BBox<3, float>;
+using vec_t = glm::vec3;
+using pair_set_t = scenes::PairSet<index_t>;
+using capsule_t = CapsuleOverlap<3, float>;
+
+TEST_CASE("segment distance") {
+	auto dist2 = [](vec_t p0, vec_t p1, vec_t q0, vec_t q1) {
+		return capsule_t::segmentDistance2(p0, p1, q0, q1);
+	};
+
+	// Crossing segments.
+	REQUIRE(dist2(vec_t(-1, 0, 0), vec_t(1, 0, 0), vec_t(0, -1, 0), vec_t(0, 1, 0)) == Catch::Approx(0.f));
+	// Skew lines, one unit apart along z.
+	REQUIRE(dist2(vec_t(-1, 0, 0), vec_t(1, 0, 0), vec_t(0, -1, 1), vec_t(0, 1, 1)) == Catch::Approx(1.f));
+	// Parallel, offset by 2.
+	REQUIRE(dist2(vec_t(0, 0, 0), vec_t(4, 0, 0), vec_t(1, 2, 0), vec_t(3, 2, 0)) == Catch::Approx(4.f));
+	// Collinear with a gap of 1 between the ends.
+	REQUIRE(dist2(vec_t(0, 0, 0), vec_t(1, 0, 0), vec_t(2, 0, 0), vec_t(5, 0, 0)) == Catch::Approx(1.f));
+	// Closest points at the end of one segment.
+	REQUIRE(dist2(vec_t(0, 0, 0), vec_t(1, 0, 0), vec_t(3, -1, 0), vec_t(3, 1, 0)) == Catch::Approx(4.f));
+	// Degenerate segments, points.
+	REQUIRE(dist2(vec_t(1, 1, 1), vec_t(1, 1, 1), vec_t(1, 1, 3), vec_t(1, 1, 3)) == Catch::Approx(4.f));
+	REQUIRE(dist2(vec_t(0, 2, 0), vec_t(0, 2, 0), vec_t(-1, 0, 0), vec_t(1, 0, 0)) == Catch::Approx(4.f));
+}
+
+TEST_CASE("narrow phase predicates") {
+	bbox_t domain(vec_t(-8.f), vec_t(8.f));
+	scenes::Random random(31);
+
+	SECTION("Spheres") {
+		const size_t count = 500;
+		std::vector<vec_t> centers(count);
+		std::vector<float> radii(count);
+		std::vector<bbox_t> bounds(count);
+		std::vector<index_t> ids(count);
+		for (size_t i = 0; i < count; ++i) {
+			for (glm::length_t k = 0; k < 3; ++k) {
+				centers[i][k] = random.uniform(-8.f, 8.f);
+			}
+			radii[i] = random.uniform(0.1f, 0.8f);
+			bounds[i] = bbox_t(centers[i] - radii[i], centers[i] + radii[i]);
+			ids[i] = static_cast<index_t>(i);
+		}
+
+		SphereOverlap<3, float> spheres{ centers.data(), radii.data() };
+		pair_set_t boxes = scenes::bruteForce(bounds, ids, BoxOverlap{});
+		pair_set_t expected = scenes::bruteForce(bounds, ids, spheres);
+		// The corners of the boxes have to produce some false positives.
+		REQUIRE(expected.size() < boxes.size());
+
+		PairList<index_t> pairs;
+		HTable<float, index_t, 3> htable(vec_t(0.5f), 5);
+		htable.build(bounds.data(), count);
+		htable.findOverlaps(ids.data(), bounds.data(), count, pairs, spheres);
+		REQUIRE(scenes::collect(pairs) == expected);
+		TableStats stats = htable.stats();
+		REQUIRE(stats.queries.accepted == expected.size());
+		REQUIRE(stats.queries.rejected == boxes.size() - expected.size());
+
+		htable.findOverlaps(ids.data(), bounds.data(), count, pairs, ThreadPool(3), spheres);
+		REQUIRE(scenes::collect(pairs) == expected);
+
+		DVTable<float, index_t, 3> dvtable;
+		dvtable.initialize(vec_t(1.f));
+		dvtable.build(bounds.data(), count);
+		dvtable.findOverlaps(ids.data(), bounds.data(), count, pairs, spheres);
+		REQUIRE(scenes::collect(pairs) == expected);
+
+		DenseTable<float, index_t, 3> dense;
+		dense.initialize(vec_t(1.f), domain);
+		dense.build(bounds.data(), count);
+		dense.findOverlaps(ids.data(), bounds.data(), count, pairs, spheres);
+		REQUIRE(scenes::collect(pairs) == expected);
+
+		// Uniform radius, and a plain lambda as the predicate.
+		SphereOverlap<3, float> uniform{ centers.data(), nullptr, 0.4f };
+		expected = scenes::bruteForce(bounds, ids, uniform);
+		dvtable.findOverlaps(ids.data(), bounds.data(), count, pairs, uniform);
+		REQUIRE(scenes::collect(pairs) == expected);
+
+		size_t visited = 0;
+		dvtable.forEachOverlap(ids.data(), bounds.data(), count, [&](index_t, index_t) {
+			++visited;
+		}, [&](index_t a, index_t b) {
+			return uniform(a, b);
+		});
+		REQUIRE(visited == expected.size());
+	}
+	SECTION("Capsules") {
+		const size_t count = 300;
+		std::vector<vec_t> first(count), second(count);
+		std::vector<float> radii(count);
+		std::vector<bbox_t> bounds(count);
+		std::vector<index_t> ids(count);
+		for (size_t i = 0; i < count; ++i) {
+			for (glm::length_t k = 0; k < 3; ++k) {
+				first[i][k] = random.uniform(-8.f, 8.f);
+				second[i][k] = first[i][k] + random.uniform(-2.f, 2.f);
+			}
+			radii[i] = random.uniform(0.05f, 0.3f);
+			bounds[i] = bbox_t(glm::min(first[i], second[i]) - radii[i], glm::max(first[i], second[i]) + radii[i]);
+			ids[i] = static_cast<index_t>(i);
+		}
+
+		capsule_t capsules{ first.data(), second.data(), radii.data() };
+		pair_set_t expected = scenes::bruteForce(bounds, ids, capsules);
+		REQUIRE(expected.size() < scenes::bruteForce(bounds, ids, BoxOverlap{}).size());
+
+		PairList<index_t> pairs;
+		HTable<float, index_t, 3> htable(vec_t(0.5f), 5);
+		htable.build(bounds.data(), count);
+		htable.findOverlaps(ids.data(), bounds.data(), count, pairs, capsules);
+		REQUIRE(scenes::collect(pairs) == expected);
+
+		OverlapCSR<index_t> csr;
+		htable.findOverlaps(ids.data(), bounds.data(), count, csr, capsules);
+		REQUIRE(csr.numPairs() == expected.size());
+	}
+}
@@ -0,0 +1,93 @@
+#include <pbd/common/BBox.hpp>
+#include <pbd/hashing/HTable.hpp>
+#include <pbd/hashing/DVTable.hpp>
+#include <pbd/hashing/SortTable.hpp>
+#include <pbd/hashing/OverlapSink.hpp>
+
+#include <Scenes.hpp>
+
+#include <catch2/catch_all.hpp>
+
+using namespace pbd;
+
+namespace {
+	using scene_t = scenes::Scene<3, float>;
+	using bbox_t = scene_t::bbox_t;
+	using vec_t = scene_t::vec_t;
+	using index_t = int32_t;
+	using pair_set_t = scenes::PairSet<index_t>;
+
+	// Run every table over the scene and compare against the brute force result.
+	void checkTables(const scene_t& scene) {
+		pair_set_t expected = scenes::bruteForce(scene.bounds, scene.ids);
+		PairList<index_t> pairs;
+
+		HTable<float, index_t, 3> htable(vec_t(1.f), 4);
+		htable.build(scene.bounds.data(), scene.size());
+		htable.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+		REQUIRE(scenes::collect(pairs) == expected);
+
+		DVTable<float, index_t, 3> dvtable;
+		dvtable.initialize(vec_t(1.f));
+		dvtable.build(scene.bounds.data(), scene.size());
+		dvtable.findOverlaps(scene.ids.data(), scene.bounds.data(), scene.size(), pairs);
+		REQUIRE(scenes::collect(pairs) == expected);
+
+		SortTable sorted;
+		sorted.build(scene.ids.data(), scene.bounds.data(), scene.size());
+		sorted.findOverlaps(pairs);
+		REQUIRE(scenes::collect(pairs) == expected);
+	}
+}
+
+TEST_CASE("scenes are reproducible") {
+	bbox_t domain(vec_t(-10.f), vec_t(10.f));
+
+	scene_t a = scenes::uniformPoints<3, float>(100, domain, 0.5f, 3);
+	scene_t b = scenes::uniformPoints<3, float>(100, domain, 0.5f, 3);
+	scene_t c = scenes::uniformPoints<3, float>(100, domain, 0.5f, 4);
+
+	REQUIRE(a.size() == 100);
+	REQUIRE(a.points == b.points);
+	REQUIRE(a.points != c.points);
+
+	for (size_t i = 0; i < a.size(); ++i) {
+		REQUIRE(a.ids[i] == static_cast<index_t>(i));
+		REQUIRE(domain.contains(a.points[i]));
+		REQUIRE(a.bounds[i].center().x == Catch::Approx(a.points[i].x));
+	}
+}
+
+TEST_CASE("scene distributions") {
+	bbox_t domain(vec_t(-8.f), vec_t(8.f));
+
+	SECTION("Uniform points") {
+		checkTables(scenes::uniformPoints<3, float>(400, domain, 0.4f, 1));
+	}
+	SECTION("Fluid block") {
+		scene_t scene = scenes::fluidBlock<3, float>(vec_t(-2.f), glm::ivec3(8, 8, 6), 0.5f, 0.3f, 0.1f, 2);
+		REQUIRE(scene.size() == 8 * 8 * 6);
+		checkTables(scene);
+	}
+	SECTION("Gaussian clusters") {
+		checkTables(scenes::gaussianClusters<3, float>(400, 5, domain, 1.f, 0.2f, 3));
+	}
+	SECTION("Heavy tailed sizes") {
+		scene_t scene = scenes::heavyTailed<3, float>(300, domain, 0.05f, 20.f, 1.1f, 4);
+		for (const bbox_t& box : scene.bounds) {
+			REQUIRE(box.size().x <= 20.f);
+		}
+		checkTables(scene);
+	}
+	SECTION("Thin boxes") {
+		checkTables(scenes::thinBoxes<3, float>(300, domain, 6.f, 0.05f, 5));
+	}
+	SECTION("Moving scene") {
+		scenes::MovingScene<3, float> moving(scenes::uniformPoints<3, float>(300, domain, 0.4f, 6), domain, 2.f, 0.9f, 7);
+		for (int i = 0; i < 5; ++i) {
+			moving.step(0.1f);
+			checkTables(moving.scene());
+		}
+		REQUIRE(moving.frames() == 5);
+	}
+}
@@ -0,0 +1,85 @@
+#include <pbd/common/BBox.hpp>
+#include <pbd/hashing/HTable.hpp>
+#include <pbd/hashing/DVTable.hpp>
+#include <pbd/hashing/OverlapSink.hpp>
+
+#include <catch2/catch_all.hpp>
+
+using namespace pbd;
+
+using bbox_t = BBox<3, float>;
+using vec_t = bbox_t::vec_t;
+using index_t = int32_t;
+
+TEST_CASE("table stats") {
+	std::vector<bbox_t> bounds{
+		// Two boxes in cell (0,0,0)
+		bbox_t(vec_t(0.1f), vec_t(0.4f)),
+		bbox_t(vec_t(0.2f), vec_t(0.6f)),
+		// Spans the eight cells around (1,1,1), overlapping the second box
+		bbox_t(vec_t(0.5f), vec_t(1.5f)),
+		// Alone in cell (5,5,5)
+		bbox_t(vec_t(5.1f), vec_t(5.2f)),
+		// Shares all eight cells with the third box
+		bbox_t(vec_t(0.7f), vec_t(1.3f)),
+	};
+	std::vector<index_t> ids{ 0, 1, 2, 3, 4 };
+
+	SECTION("DVTable") {
+		DVTable<float, index_t, 3> table;
+		table.initialize(vec_t(1.f));
+		table.build(bounds.data(), bounds.size());
+
+		TableStats stats = table.stats();
+		REQUIRE(stats.cells == 9);
+		REQUIRE(stats.entries == 2 + 8 + 1 + 8);
+		REQUIRE(stats.maxEntries == 4);
+		REQUIRE(stats.meanEntries == Catch::Approx(19.0 / 9.0));
+		// One cell with a single id, seven with two and one with four.
+		REQUIRE(stats.histogram.size() == 3);
+		REQUIRE(stats.histogram[0] == 1);
+		REQUIRE(stats.histogram[1] == 7);
+		REQUIRE(stats.histogram[2] == 1);
+		REQUIRE(stats.tiers.empty());
+		REQUIRE(stats.bytes > 0);
+		REQUIRE(stats.loadFactor > 0.0);
+
+		PairList<index_t> pairs;
+		table.findOverlaps(ids.data(), bounds.data(), bounds.size(), pairs);
+		stats = table.stats();
+		REQUIRE(pairs.size() == 3);
+#if PBD_HASHING_STATS
+		REQUIRE(stats.queries.accepted == 3);
+		// The last two boxes meet in every one of their cells, but only one of them reports the pair.
+		REQUIRE(stats.queries.duplicates == 7);
+		// Those are skipped before the box test, which only sees the pairs in their reference cell.
+		REQUIRE(stats.queries.candidates == 6);
+#endif
+	}
+
+	SECTION("HTable") {
+		HTable<float, index_t, 3> table(vec_t(1.f), 4);
+		table.build(bounds.data(), bounds.size());
+
+		TableStats stats = table.stats();
+		REQUIRE(stats.tiers.size() == 4);
+		// The boxes spanning two cells on each axis move up to the second tier.
+		REQUIRE(stats.tiers[0].objects == 3);
+		REQUIRE(stats.tiers[0].cells == 2);
+		REQUIRE(stats.tiers[1].objects == 2);
+		REQUIRE(stats.tiers[1].cells == 1);
+		REQUIRE(stats.cells == 3);
+		REQUIRE(stats.entries == 5);
+		REQUIRE(stats.maxEntries == 2);
+
+		PairList<index_t> pairs;
+		table.findOverlaps(ids.data(), bounds.data(), bounds.size(), pairs);
+		stats = table.stats();
+		REQUIRE(pairs.size() == 3);
+#if PBD_HASHING_STATS
+		REQUIRE(stats.queries.accepted == 3);
+		REQUIRE(stats.queries.duplicates == 0);
+		REQUIRE(stats.queries.candidates >= stats.queries.accepted);
+#endif
+	}
+}
@@ -0,0 +1,109 @@
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <pbd/common/BBox.hpp>
+#include <pbd/hashing/Trace.hpp>
+#include <pbd/hashing/HTable.hpp>
+#include <pbd/hashing/DVTable.hpp>
+
+#include <catch2/catch_all.hpp>
+
+using namespace pbd;
+
+using bbox_t = BBox<3, float>;
+using vec_t = bbox_t::vec_t;
+using index_t = int32_t;
+
+static std::set<std::string> eventNames() {
+	std::set<std::string> names;
+	for (const trace::Event& event : trace::Buffer::global().events()) {
+		names.insert(event.name);
+	}
+	return names;
+}
+
+TEST_CASE("trace") {
+	trace::Buffer& buffer = trace::Buffer::global();
+	buffer.clear();
+
+	SECTION("Scopes") {
+		{
+			trace::Scope outer("outer");
+			trace::Scope inner("inner");
+		}
+		std::thread([] {
+			trace::Scope scope("worker");
+		}).join();
+
+		std::vector<trace::Event> events = buffer.events();
+		REQUIRE(events.size() == 3);
+		// Scopes are recorded as they close.
+		REQUIRE(std::string(events[0].name) == "inner");
+		REQUIRE(std::string(events[1].name) == "outer");
+		REQUIRE(events[1].start <= events[0].start);
+		REQUIRE(events[1].duration >= events[0].duration);
+		REQUIRE(events[0].thread == events[1].thread);
+		REQUIRE(events[2].thread != events[0].thread);
+
+		std::ostringstream out;
+		buffer.writeChromeTrace(out);
+		std::string json = out.str();
+		REQUIRE(json.rfind("{\"traceEvents\":[", 0) == 0);
+		REQUIRE(json.find("\"name\":\"worker\"") != std::string::npos);
+		REQUIRE(json.find("\"ph\":\"X\"") != std::string::npos);
+	}
+
+	SECTION("Capacity") {
+		size_t capacity = buffer.getCapacity();
+		buffer.setCapacity(4);
+
+		for (int i = 0; i < 6; ++i) {
+			trace::Scope scope("main");
+		}
+		std::thread([] {
+			for (int i = 0; i < 5; ++i) {
+				trace::Scope scope("worker");
+			}
+		}).join();
+
+		// The limit is per thread.
+		REQUIRE(buffer.events().size() == 8);
+		REQUIRE(buffer.dropped() == 3);
+
+		buffer.clear();
+		REQUIRE(buffer.events().empty());
+		REQUIRE(buffer.dropped() == 0);
+		buffer.setCapacity(capacity);
+	}
+
+#if PBD_HASHING_TRACE
+	SECTION("Table phases") {
+		std::vector<bbox_t> bounds{
+			bbox_t(vec_t(0.1f), vec_t(0.4f)),
+			bbox_t(vec_t(0.2f), vec_t(1.6f)),
+		};
+		std::vector<index_t> ids{ 0, 1 };
+		PairList<index_t> pairs;
+
+		HTable<float, index_t, 3> htable(vec_t(1.f), 4);
+		htable.build(bounds.data(), bounds.size());
+		htable.findOverlaps(ids.data(), bounds.data(), bounds.size(), pairs);
+
+		DVTable<float, index_t, 3> dvtable;
+		dvtable.initialize(vec_t(1.f));
+		dvtable.build(bounds.data(), bounds.size());
+		dvtable.findOverlaps(ids.data(), bounds.data(), bounds.size(), pairs);
+
+		std::set<std::string> names = eventNames();
+		for (const char* name : { "HTable::classify", "HTable::count", "HTable::prefix", "HTable::insert", "HTable::findOverlaps",
+			"DVTable::count", "BaseTable::prefix", "DVTable::insert", "DVTable::findOverlaps" }) {
+			INFO(name);
+			REQUIRE(names.count(name) == 1);
+		}
+	}
+#endif
+
+	buffer.clear();
+}
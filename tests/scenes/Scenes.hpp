@@ -0,0 +1,351 @@
+#pragma once
+#include <cassert>
+#include <cinttypes>
+#include <cmath>
+#include <vector>
+#include <set>
+#include <utility>
+#include <algorithm>
+
+#include <glm/common.hpp>
+#include <pbd/common/BBox.hpp>
+
+// Reproducible scene generators for the tests and benchmarks.
+// The standard distributions are implementation defined, so the sampling is done by hand
+// on top of a fixed generator. The same seed gives the same scene with the same standard library,
+// log, cos and sqrt are not bit exact across platforms.
+namespace pbd::scenes {
+	// Small xorshift based generator, fast and the same integer sequence on every platform.
+	class Random {
+	public:
+		explicit Random(uint64_t seed) noexcept
+			: state(seed * 0x9E3779B97F4A7C15ull + 0x2545F4914F6CDD1Dull)
+		{
+			if (state == 0) {
+				state = 0x2545F4914F6CDD1Dull;
+			}
+		}
+
+		uint64_t next() noexcept {
+			state ^= state >> 12;
+			state ^= state << 25;
+			state ^= state >> 27;
+			return state * 0x2545F4914F6CDD1Dull;
+		}
+
+		// Uniform in [0, 1)
+		double uniform() noexcept {
+			return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+		}
+		double uniform(double low, double high) noexcept {
+			return low + (high - low) * uniform();
+		}
+		// Uniform integer in [0, count)
+		uint64_t index(uint64_t count) noexcept {
+			assert(count > 0);
+			return next() % count;
+		}
+		// Standard normal, Box-Muller
+		double normal() noexcept {
+			double u = 1.0 - uniform();
+			double v = uniform();
+			return std::sqrt(-2.0 * std::log(u)) * std::cos(6.283185307179586 * v);
+		}
+		// Pareto distribution with minimum 'low', shape 'alpha'.
+		// Smaller alpha gives a heavier tail.
+		double pareto(double low, double alpha) noexcept {
+			return low / std::pow(1.0 - uniform(), 1.0 / alpha);
+		}
+	private:
+		uint64_t state;
+	};
+
+	template<glm::length_t L, typename scalar_t, typename index_t = int32_t>
+	struct Scene {
+		using bbox_t = BBox<L, scalar_t>;
+		using vec_t = typename bbox_t::vec_t;
+
+		// Ids are the positions in the arrays, ready to pass to the table build and findOverlaps functions.
+		std::vector<index_t> ids;
+		// Center of every object, for the point builds.
+		std::vector<vec_t> points;
+		std::vector<bbox_t> bounds;
+
+		size_t size() const noexcept {
+			return ids.size();
+		}
+		bool empty() const noexcept {
+			return ids.empty();
+		}
+		void clear() noexcept {
+			ids.clear();
+			points.clear();
+			bounds.clear();
+		}
+		void reserve(size_t count) {
+			ids.reserve(count);
+			points.reserve(count);
+			bounds.reserve(count);
+		}
+
+		// Add an object centered on 'point' with the given half extents.
+		void add(const vec_t& point, const vec_t& half) {
+			ids.push_back(static_cast<index_t>(ids.size()));
+			points.push_back(point);
+			bounds.push_back(bbox_t(point - half, point + half));
+		}
+		// Append all the objects of another scene.
+		void append(const Scene& other) {
+			reserve(size() + other.size());
+			for (size_t i = 0; i < other.size(); ++i) {
+				ids.push_back(static_cast<index_t>(ids.size()));
+			}
+			points.insert(points.end(), other.points.begin(), other.points.end());
+			bounds.insert(bounds.end(), other.bounds.begin(), other.bounds.end());
+		}
+
+		// Smallest box containing every object.
+		bbox_t extents() const noexcept {
+			if (bounds.empty()) {
+				return bbox_t{};
+			}
+			bbox_t result = bounds.front();
+			for (const bbox_t& box : bounds) {
+				result.merge(box);
+			}
+			return result;
+		}
+	};
+
+	// Overlapping pairs as (smaller id, larger id).
+	// A multiset, so a pair reported twice by a table no longer compares equal to the brute force result.
+	template<typename index_t>
+	using PairSet = std::multiset<std::pair<index_t, index_t>>;
+
+	// Every pair of overlapping boxes, tested one against the other.
+	// The predicate is called with the two indices into the bounds like the narrow phase predicates of the tables.
+	template<typename bbox_t, typename index_t, typename Predicate>
+	PairSet<index_t> bruteForce(const std::vector<bbox_t>& bounds, const std::vector<index_t>& ids, const Predicate& predicate) {
+		assert(bounds.size() == ids.size());
+		PairSet<index_t> result;
+		for (size_t i = 0; i < bounds.size(); ++i) {
+			for (size_t j = 0; j < i; ++j) {
+				if (bounds[i].overlaps(bounds[j]) && predicate(static_cast<index_t>(i), static_cast<index_t>(j))) {
+					result.insert({ std::min(ids[i], ids[j]), std::max(ids[i], ids[j]) });
+				}
+			}
+		}
+		return result;
+	}
+	template<typename bbox_t, typename index_t>
+	PairSet<index_t> bruteForce(const std::vector<bbox_t>& bounds, const std::vector<index_t>& ids) {
+		return bruteForce(bounds, ids, [](index_t, index_t) { return true; });
+	}
+
+	// Pairs found by a table, in the same form as bruteForce.
+	template<typename index_t>
+	PairSet<index_t> collect(const std::vector<std::pair<index_t, index_t>>& pairs) {
+		PairSet<index_t> result;
+		for (auto [a, b] : pairs) {
+			result.insert({ std::min(a, b), std::max(a, b) });
+		}
+		return result;
+	}
+
+	namespace detail {
+		template<typename vec_t>
+		vec_t uniformIn(Random& rand, const vec_t& min, const vec_t& max) {
+			vec_t result;
+			for (glm::length_t i = 0; i < vec_t::length(); ++i) {
+				result[i] = static_cast<typename vec_t::value_type>(rand.uniform(min[i], max[i]));
+			}
+			return result;
+		}
+		template<typename vec_t>
+		vec_t normalAround(Random& rand, const vec_t& center, typename vec_t::value_type sigma) {
+			vec_t result;
+			for (glm::length_t i = 0; i < vec_t::length(); ++i) {
+				result[i] = center[i] + sigma * static_cast<typename vec_t::value_type>(rand.normal());
+			}
+			return result;
+		}
+	}
+
+	// Points spread uniformly over the domain, each with a box of the given radius.
+	template<glm::length_t L, typename scalar_t, typename index_t = int32_t>
+	Scene<L, scalar_t, index_t> uniformPoints(size_t count, const BBox<L, scalar_t>& domain, scalar_t radius, uint64_t seed) {
+		using vec_t = typename BBox<L, scalar_t>::vec_t;
+
+		Random rand(seed);
+		Scene<L, scalar_t, index_t> scene;
+		scene.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			scene.add(detail::uniformIn(rand, domain.min, domain.max), vec_t(radius));
+		}
+		return scene;
+	}
+
+	// Particles on a lattice starting at 'origin', like a settled fluid block.
+	// Every particle is moved by up to 'jitter' times the spacing on each axis.
+	template<glm::length_t L, typename scalar_t, typename index_t = int32_t>
+	Scene<L, scalar_t, index_t> fluidBlock(const glm::vec<L, scalar_t>& origin, const glm::vec<L, int32_t>& dims, scalar_t spacing, scalar_t radius, scalar_t jitter, uint64_t seed) {
+		using vec_t = glm::vec<L, scalar_t>;
+
+		size_t count = 1;
+		for (glm::length_t i = 0; i < L; ++i) {
+			assert(dims[i] >= 0);
+			count *= static_cast<size_t>(dims[i]);
+		}
+
+		Random rand(seed);
+		Scene<L, scalar_t, index_t> scene;
+		scene.reserve(count);
+
+		glm::vec<L, int32_t> cell(0);
+		for (size_t k = 0; k < count; ++k) {
+			vec_t point = origin + vec_t(cell) * spacing;
+			if (jitter > scalar_t(0)) {
+				point += detail::uniformIn(rand, vec_t(-jitter * spacing), vec_t(jitter * spacing));
+			}
+			scene.add(point, vec_t(radius));
+
+			// Step to the next lattice cell, first axis fastest.
+			for (glm::length_t i = 0; i < L; ++i) {
+				if (++cell[i] < dims[i]) {
+					break;
+				}
+				cell[i] = 0;
+			}
+		}
+		return scene;
+	}
+
+	// Gaussian blobs with their centers spread uniformly over the domain.
+	// Objects are split evenly between the clusters.
+	template<glm::length_t L, typename scalar_t, typename index_t = int32_t>
+	Scene<L, scalar_t, index_t> gaussianClusters(size_t count, size_t nclusters, const BBox<L, scalar_t>& domain, scalar_t sigma, scalar_t radius, uint64_t seed) {
+		using vec_t = typename BBox<L, scalar_t>::vec_t;
+		assert(nclusters > 0);
+
+		Random rand(seed);
+		std::vector<vec_t> centers(nclusters);
+		for (vec_t& center : centers) {
+			center = detail::uniformIn(rand, domain.min, domain.max);
+		}
+
+		Scene<L, scalar_t, index_t> scene;
+		scene.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			scene.add(detail::normalAround(rand, centers[i % nclusters], sigma), vec_t(radius));
+		}
+		return scene;
+	}
+
+	// Boxes with a pareto distributed size, most are close to 'minSize' with a few reaching 'maxSize'.
+	// An alpha around 1 mixes dust with the occasional building.
+	template<glm::length_t L, typename scalar_t, typename index_t = int32_t>
+	Scene<L, scalar_t, index_t> heavyTailed(size_t count, const BBox<L, scalar_t>& domain, scalar_t minSize, scalar_t maxSize, scalar_t alpha, uint64_t seed) {
+		using vec_t = typename BBox<L, scalar_t>::vec_t;
+		assert(minSize > scalar_t(0) && maxSize >= minSize);
+
+		Random rand(seed);
+		Scene<L, scalar_t, index_t> scene;
+		scene.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			vec_t point = detail::uniformIn(rand, domain.min, domain.max);
+			vec_t half;
+			for (glm::length_t k = 0; k < L; ++k) {
+				// Roughly cubic, each axis varies by up to a factor of two.
+				scalar_t size = std::min(static_cast<scalar_t>(rand.pareto(minSize, alpha)), maxSize);
+				half[k] = size * static_cast<scalar_t>(rand.uniform(0.25, 0.5));
+			}
+			scene.add(point, half);
+		}
+		return scene;
+	}
+
+	// Long thin boxes aligned to a random axis, like rope segments or cloth edges.
+	template<glm::length_t L, typename scalar_t, typename index_t = int32_t>
+	Scene<L, scalar_t, index_t> thinBoxes(size_t count, const BBox<L, scalar_t>& domain, scalar_t length, scalar_t thickness, uint64_t seed) {
+		using vec_t = typename BBox<L, scalar_t>::vec_t;
+
+		Random rand(seed);
+		Scene<L, scalar_t, index_t> scene;
+		scene.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			vec_t point = detail::uniformIn(rand, domain.min, domain.max);
+			vec_t half(thickness * scalar_t(0.5));
+			half[static_cast<glm::length_t>(rand.index(L))] = length * scalar_t(0.5);
+			scene.add(point, half);
+		}
+		return scene;
+	}
+
+	// Animates a scene with per object velocities.
+	// Coherence controls how much of the velocity is kept from one frame to the next,
+	// at 1 the objects move in straight lines, at 0 a new velocity is picked every frame.
+	// Objects bounce off the domain walls, so the density stays the same over time.
+	template<glm::length_t L, typename scalar_t, typename index_t = int32_t>
+	class MovingScene {
+	public:
+		using scene_t = Scene<L, scalar_t, index_t>;
+		using bbox_t = typename scene_t::bbox_t;
+		using vec_t = typename scene_t::vec_t;
+
+		MovingScene(scene_t initial, const bbox_t& _domain, scalar_t _speed, scalar_t _coherence, uint64_t seed)
+			: current(std::move(initial))
+			, domain(_domain)
+			, speed(_speed)
+			, coherence(_coherence)
+			, rand(seed)
+		{
+			assert(coherence >= scalar_t(0) && coherence <= scalar_t(1));
+			velocities.resize(current.size());
+			for (vec_t& velocity : velocities) {
+				velocity = randomVelocity();
+			}
+		}
+
+		// Advance all the objects by one frame.
+		void step(scalar_t dt) {
+			for (size_t i = 0; i < current.size(); ++i) {
+				vec_t& velocity = velocities[i];
+				if (coherence < scalar_t(1)) {
+					velocity = velocity * coherence + randomVelocity() * (scalar_t(1) - coherence);
+				}
+
+				vec_t& point = current.points[i];
+				bbox_t& box = current.bounds[i];
+				vec_t offset = velocity * dt;
+				for (glm::length_t k = 0; k < L; ++k) {
+					scalar_t next = point[k] + offset[k];
+					if (next < domain.min[k] || next > domain.max[k]) {
+						velocity[k] = -velocity[k];
+						offset[k] = -offset[k];
+					}
+				}
+				point += offset;
+				box.translate(offset);
+			}
+			++frame;
+		}
+
+		const scene_t& scene() const noexcept {
+			return current;
+		}
+		size_t frames() const noexcept {
+			return frame;
+		}
+	private:
+		vec_t randomVelocity() {
+			return detail::uniformIn(rand, vec_t(-speed), vec_t(speed));
+		}
+
+		scene_t current;
+		std::vector<vec_t> velocities;
+		bbox_t domain;
+		scalar_t speed, coherence;
+		Random rand;
+		size_t frame = 0;
+	};
+}